@@ -0,0 +1,174 @@
+#include <iostream>
+#include "vulkan.h"
+#include "sceneGenerator.h"
+#pragma comment(lib, "vulkan-1.lib")
+
+// 合成シーンをヘッドレスで決まったフレーム数だけ描画し、結果をJSONで出力する
+int main(int argc, char** argv)
+{
+	SceneGeneratorConfig sceneConfig;
+	EngineConfig config;
+	config.headless = true;
+	config.frameCount = 1000;
+	const char* outFile = nullptr;
+	const char* packFile = nullptr; // 合成シーンの代わりに描くアセットパック
+	const char* writePackFile = nullptr; // 合成シーンをアセットパックに書き出して終わる
+	bool instanced = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string_view arg = argv[i];
+		if (arg == "--instanced")
+		{
+			// 四角形1つを--quadsの数だけインスタンス描画する
+			instanced = true;
+			continue;
+		}
+		if (arg == "--no-indirect")
+		{
+			config.indirectDraws = false;
+			continue;
+		}
+		if (arg == "--no-gpu-culling")
+		{
+			config.gpuCulling = false;
+			continue;
+		}
+		if (arg == "--no-push-constants")
+		{
+			config.pushConstants = false;
+			continue;
+		}
+		if (arg == "--no-pipeline-cache")
+		{
+			config.pipelineCacheFile = nullptr;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			break;
+		}
+		if (arg == "--quads")
+		{
+			sceneConfig.quadCount = static_cast<uint32_t>(stoul(argv[++i]));
+		}
+		else if (arg == "--quads-per-mesh")
+		{
+			sceneConfig.quadsPerMesh = static_cast<uint32_t>(stoul(argv[++i]));
+		}
+		else if (arg == "--quad-size")
+		{
+			sceneConfig.quadSize = stof(argv[++i]);
+		}
+		else if (arg == "--seed")
+		{
+			sceneConfig.seed = static_cast<uint32_t>(stoul(argv[++i]));
+		}
+		else if (arg == "--frames")
+		{
+			config.frameCount = static_cast<uint32_t>(stoul(argv[++i]));
+		}
+		else if (arg == "--frames-in-flight")
+		{
+			config.framesInFlight = static_cast<uint32_t>(stoul(argv[++i]));
+		}
+		else if (arg == "--vertex-format")
+		{
+			if (!parseVertexFormat(argv[++i], config.vertexFormat))
+			{
+				std::cerr << "unknown vertex format: " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--pipeline-cache")
+		{
+			config.pipelineCacheFile = argv[++i];
+		}
+		else if (arg == "--profile")
+		{
+			config.profileFile = argv[++i];
+		}
+		else if (arg == "--pack")
+		{
+			packFile = argv[++i];
+		}
+		else if (arg == "--write-pack")
+		{
+			writePackFile = argv[++i];
+		}
+		else if (arg == "--out")
+		{
+			outFile = argv[++i];
+		}
+	}
+
+	if (writePackFile)
+	{
+		AssetPackWriter writer;
+		vector<Mesh> meshes = generateQuadScene(sceneConfig);
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			writer.addMesh("mesh" + to_string(i), meshes[i], config.vertexFormat, config.optimizeMeshes);
+		}
+		writer.write(writePackFile);
+		cout << writePackFile << ": " << meshes.size() << " meshes" << endl;
+		return 0;
+	}
+
+	Vulkan engine(config);
+	size_t meshCount = 0;
+	if (packFile)
+	{
+		meshCount = engine.addAssetPack(packFile);
+	}
+	else if (instanced)
+	{
+		vector<InstanceData> instances;
+		Mesh quad = generateQuadInstances(sceneConfig, instances);
+		engine.addInstancedMesh(std::move(quad), std::move(instances));
+		meshCount = 1;
+	}
+	else
+	{
+		vector<Mesh> meshes = generateQuadScene(sceneConfig);
+		meshCount = meshes.size();
+		for (auto& mesh : meshes)
+		{
+			engine.addMesh(std::move(mesh));
+		}
+	}
+	engine.run();
+
+	FrameStats stats = engine.getFrameStats();
+
+	ofstream ofs;
+	if (outFile)
+	{
+		ofs.open(outFile);
+	}
+	ostream& os = outFile ? ofs : cout;
+
+	os << "{\n"
+		<< "  \"quads\": " << sceneConfig.quadCount << ",\n"
+		<< "  \"meshes\": " << meshCount << ",\n"
+		<< "  \"pack\": " << (packFile ? "true" : "false") << ",\n"
+		<< "  \"instanced\": " << (instanced ? "true" : "false") << ",\n"
+		<< "  \"indirect\": " << (engine.usesIndirectDraws() ? "true" : "false") << ",\n"
+		<< "  \"gpu_culling\": " << (engine.usesGpuCulling() ? "true" : "false") << ",\n"
+		<< "  \"push_constants\": " << (engine.usesPushConstants() ? "true" : "false") << ",\n"
+		<< "  \"quad_size\": " << sceneConfig.quadSize << ",\n"
+		<< "  \"frames_in_flight\": " << config.framesInFlight << ",\n"
+		<< "  \"vertex_format\": \"" << vertexFormatName(engine.getVertexFormat()) << "\",\n"
+		<< "  \"frames\": " << stats.frameCount << ",\n"
+		<< "  \"seconds\": " << stats.elapsedSeconds << ",\n"
+		<< "  \"fps\": " << stats.framesPerSecond << ",\n"
+		<< "  \"cpu_ms_per_frame\": " << stats.cpuMsPerFrame << ",\n"
+		<< "  \"gpu_ms_per_frame\": " << stats.gpuMsPerFrame << ",\n"
+		<< "  \"bytes_uploaded\": " << stats.bytesUploaded << ",\n"
+		<< "  \"upload_ms\": " << stats.uploadMs << ",\n"
+		<< "  \"pipeline_ms\": " << stats.pipelineCreateMs << ",\n"
+		<< "  \"pipeline_cache_warm\": " << (stats.pipelineCacheWarm ? "true" : "false") << "\n"
+		<< "}\n";
+
+	return 0;
+}
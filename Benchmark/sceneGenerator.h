@@ -0,0 +1,88 @@
+#pragma once
+
+#include "mesh.h"
+#include "instanceData.h"
+#include <random>
+#include <algorithm>
+
+struct SceneGeneratorConfig
+{
+	uint32_t quadCount = 1000;
+	uint32_t quadsPerMesh = 1000; // 1メッシュにまとめる四角形の数
+	float quadSize = 0.02f; // NDCでの一辺の長さ
+	uint32_t seed = 1;
+	float animationRadius = 0.05f; // インスタンスが回る半径
+};
+
+// 画面内にランダムな色の四角形を敷き詰めたメッシュ群を作る
+inline vector<Mesh> generateQuadScene(const SceneGeneratorConfig& config)
+{
+	mt19937 rng(config.seed);
+	uniform_real_distribution<float> position(-1.0f, 1.0f);
+	uniform_real_distribution<float> color(0.0f, 1.0f);
+
+	uint32_t quadsPerMesh = std::max(config.quadsPerMesh, 1u);
+	float h = config.quadSize * 0.5f;
+
+	vector<Mesh> meshes;
+	for (uint32_t first = 0; first < config.quadCount; first += quadsPerMesh)
+	{
+		uint32_t count = std::min(quadsPerMesh, config.quadCount - first);
+
+		Mesh mesh;
+		mesh.vert.reserve(size_t(count) * 4);
+		mesh.indices.reserve(size_t(count) * 6);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			Vec2 c{ position(rng), position(rng) };
+			Vec3 col{ color(rng), color(rng), color(rng) };
+			uint32_t base = static_cast<uint32_t>(mesh.vert.size());
+
+			// Triangleと同じ頂点の並びと巻き順
+			mesh.vert.push_back(Vertex{ Vec2{ c.x - h, c.y - h }, col });
+			mesh.vert.push_back(Vertex{ Vec2{ c.x + h, c.y + h }, col });
+			mesh.vert.push_back(Vertex{ Vec2{ c.x - h, c.y + h }, col });
+			mesh.vert.push_back(Vertex{ Vec2{ c.x + h, c.y - h }, col });
+
+			for (uint32_t index : { 0u, 1u, 2u, 1u, 0u, 3u })
+			{
+				mesh.indices.push_back(base + index);
+			}
+		}
+		meshes.push_back(std::move(mesh));
+	}
+	return meshes;
+}
+
+// 原点の四角形1つと、それを画面内に散らばせるインスタンスを作る
+inline Mesh generateQuadInstances(const SceneGeneratorConfig& config, vector<InstanceData>& instances)
+{
+	mt19937 rng(config.seed);
+	uniform_real_distribution<float> position(-1.0f, 1.0f);
+	uniform_real_distribution<float> color(0.0f, 1.0f);
+	uniform_real_distribution<float> phase(0.0f, 6.2831853f);
+
+	float h = config.quadSize * 0.5f;
+	Mesh quad;
+	quad.vert = {
+		Vertex{ Vec2{ -h, -h }, Vec3{ 1.0f, 1.0f, 1.0f } },
+		Vertex{ Vec2{  h,  h }, Vec3{ 1.0f, 1.0f, 1.0f } },
+		Vertex{ Vec2{ -h,  h }, Vec3{ 1.0f, 1.0f, 1.0f } },
+		Vertex{ Vec2{  h, -h }, Vec3{ 1.0f, 1.0f, 1.0f } },
+	};
+	quad.indices = { 0, 1, 2, 1, 0, 3 };
+
+	instances.clear();
+	instances.reserve(config.quadCount);
+	for (uint32_t i = 0; i < config.quadCount; i++)
+	{
+		InstanceData instance;
+		instance.offset = Vec2{ position(rng), position(rng) };
+		instance.scale = 1.0f;
+		instance.phase = phase(rng);
+		instance.color = Vec3{ color(rng), color(rng), color(rng) };
+		instance.radius = config.animationRadius;
+		instances.push_back(instance);
+	}
+	return quad;
+}
@@ -0,0 +1,363 @@
+#include "assetPack.h"
+#include "meshOptimizer.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+	uint64_t alignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	template<class T>
+	void append(vector<uint8_t>& bytes, const T& value)
+	{
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+		bytes.insert(bytes.end(), p, p + sizeof(T));
+	}
+}
+
+uint64_t hashAssetName(string_view name)
+{
+	// 0は空きを表すので使わない
+	uint64_t hash = fnv1a(name.data(), name.size());
+	return hash != 0 ? hash : 1;
+}
+
+bool AssetPack::open(const char* fileName)
+{
+	close();
+	if (!file.open(fileName))
+	{
+		return false;
+	}
+
+	const uint8_t* base = file.data();
+	uint64_t size = file.size();
+	auto fail = [&](const char* reason) {
+		close();
+		throw runtime_error(string("invalid asset pack ") + fileName + ": " + reason);
+	};
+
+	if (size < sizeof(AssetPackHeader))
+	{
+		fail("too small");
+	}
+	header = reinterpret_cast<const AssetPackHeader*>(base);
+	if (header->magic != assetPackMagic || header->version != assetPackVersion)
+	{
+		fail("bad magic or version");
+	}
+	if (header->fileSize != size)
+	{
+		fail("truncated");
+	}
+
+	uint32_t slotCount = header->slotCount;
+	if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0 || slotCount <= header->entryCount)
+	{
+		fail("bad index table");
+	}
+	if (header->entryOffset % alignof(AssetPackEntry) != 0 || header->slotOffset % alignof(uint32_t) != 0 ||
+		header->entryOffset + uint64_t(header->entryCount) * sizeof(AssetPackEntry) > size ||
+		header->slotOffset + uint64_t(slotCount) * sizeof(uint32_t) > size ||
+		header->nameOffset > size)
+	{
+		fail("table out of range");
+	}
+
+	entries = reinterpret_cast<const AssetPackEntry*>(base + header->entryOffset);
+	slots = reinterpret_cast<const uint32_t*>(base + header->slotOffset);
+	names = reinterpret_cast<const char*>(base + header->nameOffset);
+	namesSize = size - header->nameOffset;
+
+	for (uint32_t i = 0; i < header->entryCount; i++)
+	{
+		const AssetPackEntry& entry = entries[i];
+		if (entry.offset % assetPackAlignment != 0 || entry.offset > size || entry.size > size - entry.offset ||
+			uint64_t(entry.nameOffset) + entry.nameLength > namesSize)
+		{
+			fail("entry out of range");
+		}
+		// SPIR-Vは4バイトの語の並びで、そのままcodeSizeに渡す
+		if (entry.type == AssetType::Shader && (entry.size == 0 || entry.size % sizeof(uint32_t) != 0))
+		{
+			fail("bad shader size");
+		}
+	}
+	uint32_t emptySlotCount = 0;
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		if (slots[i] == UINT32_MAX)
+		{
+			emptySlotCount++;
+		}
+		else if (slots[i] >= header->entryCount)
+		{
+			fail("bad slot");
+		}
+	}
+	// find()の探索は空きに当たるまで続くので、空きがなければ止まらない
+	if (emptySlotCount == 0)
+	{
+		fail("bad index table");
+	}
+
+	// メッシュは転送前に確かめる。インデックスが頂点の外を指すと、GPUが他のメッシュやページの外の頂点を読む
+	for (uint32_t i = 0; i < header->entryCount; i++)
+	{
+		AssetView asset = getEntry(i);
+		if (asset.type != AssetType::Mesh)
+		{
+			continue;
+		}
+		optional<MeshView> mesh = getMesh(asset);
+		if (!mesh)
+		{
+			fail("bad mesh");
+		}
+		if (!indicesInRange(*mesh))
+		{
+			fail("mesh index out of range");
+		}
+	}
+	return true;
+}
+
+void AssetPack::close()
+{
+	file.close();
+	header = nullptr;
+	entries = nullptr;
+	slots = nullptr;
+	names = nullptr;
+	namesSize = 0;
+}
+
+string_view AssetPack::getName(const AssetPackEntry& entry) const
+{
+	return string_view(names + entry.nameOffset, entry.nameLength);
+}
+
+AssetView AssetPack::getEntry(uint32_t index) const
+{
+	const AssetPackEntry& entry = entries[index];
+	return AssetView{ getName(entry), entry.type, file.data() + entry.offset, entry.size };
+}
+
+optional<AssetView> AssetPack::find(string_view name) const
+{
+	if (!header)
+	{
+		return nullopt;
+	}
+
+	uint64_t hash = hashAssetName(name);
+	uint32_t mask = header->slotCount - 1;
+	// open()で空きがあることを確かめているので必ず止まる
+	for (uint32_t slot = uint32_t(hash) & mask; slots[slot] != UINT32_MAX; slot = (slot + 1) & mask)
+	{
+		const AssetPackEntry& entry = entries[slots[slot]];
+		if (entry.nameHash == hash && getName(entry) == name)
+		{
+			return getEntry(slots[slot]);
+		}
+	}
+	return nullopt;
+}
+
+optional<MeshView> AssetPack::getMesh(const AssetView& asset) const
+{
+	if (asset.type != AssetType::Mesh || asset.size < sizeof(PackedMeshHeader))
+	{
+		return nullopt;
+	}
+	const PackedMeshHeader* mesh = reinterpret_cast<const PackedMeshHeader*>(asset.data);
+	// 頂点はGPUの頂点形式の大きさでそのまま転送するので、ストライドは形式から決まる値でなければならない
+	bool knownFormat = mesh->vertexFormat == VertexFormat::Float32 || mesh->vertexFormat == VertexFormat::Half ||
+		mesh->vertexFormat == VertexFormat::Snorm16;
+	if (!knownFormat || mesh->vertexStride != getVertexLayout(mesh->vertexFormat).stride ||
+		(mesh->indexSize != 2 && mesh->indexSize != 4) || mesh->indexOffset % mesh->indexSize != 0 ||
+		mesh->vertexOffset + uint64_t(mesh->vertexStride) * mesh->vertexCount > asset.size ||
+		mesh->indexOffset + uint64_t(mesh->indexSize) * mesh->indexCount > asset.size)
+	{
+		return nullopt;
+	}
+	return MeshView{ mesh, asset.data + mesh->vertexOffset, asset.data + mesh->indexOffset };
+}
+
+bool AssetPack::indicesInRange(const MeshView& mesh)
+{
+	uint32_t vertexCount = mesh.header->vertexCount;
+	uint32_t indexCount = mesh.header->indexCount;
+	if (mesh.header->indexSize == 2)
+	{
+		const uint16_t* indices = static_cast<const uint16_t*>(mesh.indices);
+		return std::all_of(indices, indices + indexCount, [&](uint16_t index) { return index < vertexCount; });
+	}
+	const uint32_t* indices = static_cast<const uint32_t*>(mesh.indices);
+	return std::all_of(indices, indices + indexCount, [&](uint32_t index) { return index < vertexCount; });
+}
+
+optional<TextureView> AssetPack::getTexture(const AssetView& asset) const
+{
+	if (asset.type != AssetType::Texture || asset.size < sizeof(PackedTextureHeader))
+	{
+		return nullopt;
+	}
+	const PackedTextureHeader* texture = reinterpret_cast<const PackedTextureHeader*>(asset.data);
+	if (texture->dataOffset > asset.size)
+	{
+		return nullopt;
+	}
+	return TextureView{ texture, asset.data + texture->dataOffset, asset.size - texture->dataOffset };
+}
+
+bool AssetPackWriter::contains(string_view name) const
+{
+	return std::any_of(assets.begin(), assets.end(), [&](const Asset& asset) { return asset.name == name; });
+}
+
+void AssetPackWriter::addRaw(string_view name, AssetType type, const void* data, size_t size)
+{
+	if (contains(name))
+	{
+		throw runtime_error("duplicate asset name: " + string(name));
+	}
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	assets.push_back(Asset{ string(name), type, vector<uint8_t>(bytes, bytes + size) });
+}
+
+void AssetPackWriter::addShader(string_view name, const uint32_t* code, size_t size)
+{
+	if (size == 0 || size % sizeof(uint32_t) != 0)
+	{
+		throw runtime_error("invalid SPIR-V size: " + string(name));
+	}
+	addRaw(name, AssetType::Shader, code, size);
+}
+
+void AssetPackWriter::addMesh(string_view name, const Mesh& mesh, VertexFormat format, bool optimize)
+{
+	OptimizedMesh optimized = optimizeMesh(mesh, optimize);
+	vector<uint8_t> vertices = encodeVertices(optimized.vertices, format);
+
+	PackedMeshHeader header = {};
+	header.vertexFormat = format;
+	header.vertexStride = getVertexLayout(format).stride;
+	header.vertexCount = static_cast<uint32_t>(optimized.vertices.size());
+	header.indexSize = static_cast<uint32_t>(optimized.indexSize());
+	header.indexCount = optimized.indexCount();
+	header.vertexOffset = static_cast<uint32_t>(alignUp(sizeof(PackedMeshHeader), 16));
+	header.indexOffset = static_cast<uint32_t>(alignUp(header.vertexOffset + vertices.size(), 4));
+	computeBounds(optimized.vertices, header.boundsCenter, header.boundsRadius);
+
+	vector<uint8_t> blob(header.indexOffset + header.indexSize * header.indexCount);
+	memcpy(blob.data(), &header, sizeof(header));
+	if (!vertices.empty())
+	{
+		memcpy(blob.data() + header.vertexOffset, vertices.data(), vertices.size());
+	}
+	if (header.indexCount > 0)
+	{
+		memcpy(blob.data() + header.indexOffset, optimized.indexData(), size_t(header.indexSize) * header.indexCount);
+	}
+	addRaw(name, AssetType::Mesh, blob.data(), blob.size());
+}
+
+void AssetPackWriter::addTexture(string_view name, vk::Format format, uint32_t width, uint32_t height, const void* pixels, size_t size)
+{
+	PackedTextureHeader header = { format, width, height, static_cast<uint32_t>(alignUp(sizeof(PackedTextureHeader), 16)) };
+	vector<uint8_t> blob(header.dataOffset + size);
+	memcpy(blob.data(), &header, sizeof(header));
+	memcpy(blob.data() + header.dataOffset, pixels, size);
+	addRaw(name, AssetType::Texture, blob.data(), blob.size());
+}
+
+void AssetPackWriter::write(const char* fileName) const
+{
+	uint32_t entryCount = static_cast<uint32_t>(assets.size());
+	// 負荷率を1/2以下にする
+	uint32_t slotCount = 2;
+	while (slotCount < entryCount * 2 + 1)
+	{
+		slotCount *= 2;
+	}
+
+	vector<AssetPackEntry> entries(entryCount);
+	vector<uint32_t> slots(slotCount, UINT32_MAX);
+	string names;
+
+	AssetPackHeader header = {};
+	header.magic = assetPackMagic;
+	header.version = assetPackVersion;
+	header.entryCount = entryCount;
+	header.slotCount = slotCount;
+	header.entryOffset = alignUp(sizeof(AssetPackHeader), 16);
+	header.slotOffset = header.entryOffset + sizeof(AssetPackEntry) * entryCount;
+	header.nameOffset = header.slotOffset + sizeof(uint32_t) * slotCount;
+
+	for (uint32_t i = 0; i < entryCount; i++)
+	{
+		entries[i].nameHash = hashAssetName(assets[i].name);
+		entries[i].type = assets[i].type;
+		entries[i].size = assets[i].data.size();
+		entries[i].nameOffset = static_cast<uint32_t>(names.size());
+		entries[i].nameLength = static_cast<uint32_t>(assets[i].name.size());
+		names += assets[i].name;
+
+		uint32_t slot = uint32_t(entries[i].nameHash) & (slotCount - 1);
+		while (slots[slot] != UINT32_MAX)
+		{
+			slot = (slot + 1) & (slotCount - 1);
+		}
+		slots[slot] = i;
+	}
+
+	uint64_t offset = alignUp(header.nameOffset + names.size(), assetPackAlignment);
+	for (auto& entry : entries)
+	{
+		entry.offset = offset;
+		offset = alignUp(offset + entry.size, assetPackAlignment);
+	}
+	header.fileSize = entries.empty() ? header.nameOffset + names.size() : entries.back().offset + entries.back().size;
+
+	ofstream ofs(fileName, ios::binary | ios::trunc);
+	if (!ofs)
+	{
+		throw runtime_error(string("failed to create asset pack: ") + fileName);
+	}
+
+	uint64_t written = 0;
+	auto put = [&](const void* data, uint64_t size) {
+		ofs.write(static_cast<const char*>(data), streamsize(size));
+		written += size;
+	};
+	auto padTo = [&](uint64_t position) {
+		static const char zeros[assetPackAlignment] = {};
+		while (written < position)
+		{
+			put(zeros, std::min<uint64_t>(position - written, sizeof(zeros)));
+		}
+	};
+
+	put(&header, sizeof(header));
+	padTo(header.entryOffset);
+	put(entries.data(), sizeof(AssetPackEntry) * entries.size());
+	put(slots.data(), sizeof(uint32_t) * slots.size());
+	put(names.data(), names.size());
+	for (uint32_t i = 0; i < entryCount; i++)
+	{
+		padTo(entries[i].offset);
+		put(assets[i].data.data(), assets[i].data.size());
+	}
+
+	if (!ofs.flush())
+	{
+		throw runtime_error(string("failed to write asset pack: ") + fileName);
+	}
+}
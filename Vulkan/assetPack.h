@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mappedFile.h"
+#include "mesh.h"
+#include "vertexFormat.h"
+
+using namespace std;
+
+// 1つのファイルにSPIR-V・メッシュ・テクスチャをまとめたアセットパック
+//
+//   AssetPackHeader
+//   AssetPackEntry[entryCount]   名前のハッシュ、ブロブの位置と大きさ
+//   uint32_t[slotCount]          ハッシュからエントリを引く開番地法の表（空きはUINT32_MAX）
+//   char[]                       名前
+//   ブロブ                        それぞれassetPackAlignmentに揃える
+//
+// マップしたまま読むので、ブロブのポインタをそのままステージングへのコピーに渡せる
+enum class AssetType : uint32_t
+{
+	Raw,
+	Shader, // SPIR-Vの語の並び
+	Mesh, // PackedMeshHeaderの後に頂点とインデックス
+	Texture, // PackedTextureHeaderの後にピクセル
+};
+
+constexpr uint32_t assetPackMagic = 0x4b415041; // "APAK"
+constexpr uint32_t assetPackVersion = 1;
+constexpr uint64_t assetPackAlignment = 256; // optimalBufferCopyOffsetAlignmentとSPIR-Vの両方を満たす
+
+struct AssetPackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t slotCount; // 2のべき乗
+	uint64_t entryOffset;
+	uint64_t slotOffset;
+	uint64_t nameOffset;
+	uint64_t fileSize;
+};
+
+struct AssetPackEntry
+{
+	uint64_t nameHash;
+	uint64_t offset;
+	uint64_t size;
+	AssetType type;
+	uint32_t nameOffset; // 名前の表の中の位置
+	uint32_t nameLength;
+	uint32_t pad;
+};
+
+// 最適化とGPUの形式へのエンコードを済ませたメッシュ。そのままGeometryArenaに渡せる
+struct PackedMeshHeader
+{
+	VertexFormat vertexFormat;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexSize; // 2か4
+	uint32_t indexCount;
+	uint32_t vertexOffset; // ブロブの先頭から
+	uint32_t indexOffset;
+	float boundsRadius;
+	Vec2 boundsCenter;
+	uint32_t pad[2];
+};
+
+struct PackedTextureHeader
+{
+	vk::Format format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t dataOffset;
+};
+
+struct AssetView
+{
+	string_view name;
+	AssetType type;
+	const uint8_t* data;
+	uint64_t size;
+};
+
+struct MeshView
+{
+	const PackedMeshHeader* header;
+	const void* vertices;
+	const void* indices;
+
+	vk::IndexType indexType() const { return header->indexSize == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32; }
+};
+
+struct TextureView
+{
+	const PackedTextureHeader* header;
+	const void* pixels;
+	uint64_t size;
+};
+
+// 読み込み側。開くときに表と範囲だけを検証し、ブロブには触らない
+class AssetPack
+{
+public:
+	// 壊れていればruntime_errorを投げる。ファイルがなければfalse
+	// メッシュのヘッダとインデックスが頂点数の範囲に収まっているかもここで確かめる
+	bool open(const char* fileName);
+	void close();
+	bool isOpen() const { return file.isOpen(); }
+
+	uint32_t getEntryCount() const { return header ? header->entryCount : 0; }
+	AssetView getEntry(uint32_t index) const;
+	optional<AssetView> find(string_view name) const;
+
+	// 形式・ストライド・範囲が正しくなければnullopt。インデックスの範囲はopen()で確かめてある
+	optional<MeshView> getMesh(const AssetView& asset) const;
+	optional<TextureView> getTexture(const AssetView& asset) const;
+
+private:
+	string_view getName(const AssetPackEntry& entry) const;
+	static bool indicesInRange(const MeshView& mesh);
+
+	MappedFile file;
+	const AssetPackHeader* header = nullptr;
+	const AssetPackEntry* entries = nullptr;
+	const uint32_t* slots = nullptr;
+	const char* names = nullptr;
+	uint64_t namesSize = 0;
+};
+
+// 書き出し側。ブロブは書き出すまでメモリに持つ
+class AssetPackWriter
+{
+public:
+	void addRaw(string_view name, AssetType type, const void* data, size_t size);
+	void addShader(string_view name, const uint32_t* code, size_t size);
+	// 読み込み時にCPUで処理しなくて済むよう、ここで最適化してGPUの形式にエンコードしておく
+	void addMesh(string_view name, const Mesh& mesh, VertexFormat format, bool optimize);
+	void addTexture(string_view name, vk::Format format, uint32_t width, uint32_t height, const void* pixels, size_t size);
+
+	// 同じ名前があればfalse
+	bool contains(string_view name) const;
+	void write(const char* fileName) const;
+
+private:
+	struct Asset
+	{
+		string name;
+		AssetType type;
+		vector<uint8_t> data;
+	};
+	vector<Asset> assets;
+};
+
+uint64_t hashAssetName(string_view name);
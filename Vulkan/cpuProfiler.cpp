@@ -0,0 +1,120 @@
+#include "cpuProfiler.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+CpuProfiler::CpuProfiler(size_t windowSize) : windowSize(windowSize)
+{
+	for (auto& samples : phases)
+	{
+		samples.ring.resize(windowSize);
+	}
+}
+
+void CpuProfiler::record(FramePhase phase, double ms)
+{
+	PhaseSamples& samples = phases[static_cast<size_t>(phase)];
+	samples.ring[samples.next] = ms;
+	samples.next = (samples.next + 1) % windowSize;
+	samples.count++;
+}
+
+CpuProfiler::PhaseStats CpuProfiler::getStats(FramePhase phase) const
+{
+	const PhaseSamples& samples = phases[static_cast<size_t>(phase)];
+
+	PhaseStats stats{};
+	stats.name = phaseName(phase);
+	stats.sampleCount = samples.count;
+
+	size_t n = static_cast<size_t>(std::min<uint64_t>(samples.count, windowSize));
+	if (n == 0)
+	{
+		return stats;
+	}
+
+	// 集計は書き出すときだけなので、ここでコピーして並べ替える
+	vector<double> sorted(samples.ring.begin(), samples.ring.begin() + n);
+	std::sort(sorted.begin(), sorted.end());
+
+	auto percentile = [&](double p) {
+		size_t index = static_cast<size_t>(p * double(n - 1) + 0.5);
+		return sorted[std::min(index, n - 1)];
+	};
+
+	double sum = 0.0;
+	for (double ms : sorted)
+	{
+		sum += ms;
+	}
+
+	stats.p50Ms = percentile(0.50);
+	stats.p95Ms = percentile(0.95);
+	stats.p99Ms = percentile(0.99);
+	stats.maxMs = sorted.back();
+	stats.averageMs = sum / double(n);
+	return stats;
+}
+
+bool CpuProfiler::dump(const char* fileName) const
+{
+	ofstream ofs(fileName);
+	if (!ofs.is_open())
+	{
+		std::cerr << "プロファイル結果を書き出せません: " << fileName << std::endl;
+		return false;
+	}
+
+	string_view name = fileName;
+	if (name.size() >= 5 && name.substr(name.size() - 5) == ".json")
+	{
+		writeJson(ofs);
+	}
+	else
+	{
+		writeCsv(ofs);
+	}
+	return true;
+}
+
+void CpuProfiler::writeCsv(ostream& os) const
+{
+	os << "phase,samples,p50_ms,p95_ms,p99_ms,max_ms,avg_ms\n";
+	for (uint32_t i = 0; i < static_cast<uint32_t>(FramePhase::Count); i++)
+	{
+		PhaseStats stats = getStats(static_cast<FramePhase>(i));
+		os << stats.name << ',' << stats.sampleCount << ',' << stats.p50Ms << ',' << stats.p95Ms << ','
+			<< stats.p99Ms << ',' << stats.maxMs << ',' << stats.averageMs << '\n';
+	}
+}
+
+void CpuProfiler::writeJson(ostream& os) const
+{
+	os << "{\n";
+	for (uint32_t i = 0; i < static_cast<uint32_t>(FramePhase::Count); i++)
+	{
+		PhaseStats stats = getStats(static_cast<FramePhase>(i));
+		os << "  \"" << stats.name << "\": { \"samples\": " << stats.sampleCount
+			<< ", \"p50_ms\": " << stats.p50Ms << ", \"p95_ms\": " << stats.p95Ms
+			<< ", \"p99_ms\": " << stats.p99Ms << ", \"max_ms\": " << stats.maxMs
+			<< ", \"avg_ms\": " << stats.averageMs << " }";
+		os << (i + 1 < static_cast<uint32_t>(FramePhase::Count) ? ",\n" : "\n");
+	}
+	os << "}\n";
+}
+
+const char* CpuProfiler::phaseName(FramePhase phase)
+{
+	switch (phase)
+	{
+	case FramePhase::PollEvents: return "poll_events";
+	case FramePhase::UniformUpdate: return "uniform_update";
+	case FramePhase::WaitFence: return "wait_fence";
+	case FramePhase::Acquire: return "acquire";
+	case FramePhase::Render: return "render";
+	case FramePhase::Present: return "present";
+	case FramePhase::Frame: return "frame";
+	default: return "unknown";
+	}
+}
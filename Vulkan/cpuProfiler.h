@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// フレームループの区間
+enum class FramePhase : uint32_t
+{
+	PollEvents,
+	UniformUpdate,
+	WaitFence,
+	Acquire,
+	Render,
+	Present,
+	Frame,
+	Count
+};
+
+// フレームの区間ごとにCPU時間を計測し、直近のサンプルからパーセンタイルを出す
+class CpuProfiler
+{
+public:
+	// 生成から破棄までの時間を記録する
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(CpuProfiler& profiler, FramePhase phase)
+			: profiler(profiler), phase(phase), start(chrono::steady_clock::now()) {}
+		~ScopedTimer()
+		{
+			profiler.record(phase, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+		}
+	private:
+		CpuProfiler& profiler;
+		FramePhase phase;
+		chrono::steady_clock::time_point start;
+	};
+
+	struct PhaseStats
+	{
+		const char* name;
+		uint64_t sampleCount;
+		double p50Ms, p95Ms, p99Ms, maxMs, averageMs;
+	};
+
+	explicit CpuProfiler(size_t windowSize = 4096);
+
+	void record(FramePhase phase, double ms);
+	PhaseStats getStats(FramePhase phase) const;
+
+	// 拡張子が.jsonならJSON、それ以外はCSVで書き出す
+	bool dump(const char* fileName) const;
+	void writeCsv(ostream& os) const;
+	void writeJson(ostream& os) const;
+
+	static const char* phaseName(FramePhase phase);
+
+private:
+	struct PhaseSamples
+	{
+		vector<double> ring; // 直近windowSize個のサンプル
+		size_t next = 0;
+		uint64_t count = 0;
+	};
+
+	size_t windowSize;
+	PhaseSamples phases[static_cast<size_t>(FramePhase::Count)];
+};
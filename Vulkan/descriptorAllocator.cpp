@@ -0,0 +1,141 @@
+#include "descriptorAllocator.h"
+#include "hash.h"
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+	// 1セットあたりに見込むディスクリプタの数。プールの大きさはこれにセット数を掛ける
+	struct PoolSizeRatio
+	{
+		vk::DescriptorType type;
+		float ratio;
+	};
+
+	constexpr PoolSizeRatio poolSizeRatios[] = {
+		{ vk::DescriptorType::eUniformBuffer, 2.0f },
+		{ vk::DescriptorType::eUniformBufferDynamic, 1.0f },
+		{ vk::DescriptorType::eStorageBuffer, 8.0f },
+		{ vk::DescriptorType::eStorageBufferDynamic, 1.0f },
+		{ vk::DescriptorType::eCombinedImageSampler, 4.0f },
+		{ vk::DescriptorType::eSampledImage, 2.0f },
+		{ vk::DescriptorType::eStorageImage, 1.0f },
+		{ vk::DescriptorType::eSampler, 1.0f },
+	};
+
+	constexpr uint32_t maxSetsPerPool = 4096;
+
+	bool sameBinding(const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b)
+	{
+		return a.binding == b.binding && a.descriptorType == b.descriptorType && a.descriptorCount == b.descriptorCount
+			&& a.stageFlags == b.stageFlags && a.pImmutableSamplers == b.pImmutableSamplers;
+	}
+}
+
+void DescriptorLayoutCache::init(vk::Device device)
+{
+	this->device = device;
+}
+
+vk::DescriptorSetLayout DescriptorLayoutCache::get(vk::ArrayProxy<const vk::DescriptorSetLayoutBinding> bindings)
+{
+	vector<vk::DescriptorSetLayoutBinding> sorted(bindings.begin(), bindings.end());
+	std::sort(sorted.begin(), sorted.end(), [](const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b) {
+		return a.binding < b.binding;
+	});
+
+	// 構造体のパディングを含めないよう、フィールドごとにハッシュする
+	uint64_t hash = fnv1aOffsetBasis;
+	for (const vk::DescriptorSetLayoutBinding& binding : sorted)
+	{
+		VkShaderStageFlags stageFlags = static_cast<VkShaderStageFlags>(binding.stageFlags);
+		hash = fnv1a(&binding.binding, sizeof(binding.binding), hash);
+		hash = fnv1a(&binding.descriptorType, sizeof(binding.descriptorType), hash);
+		hash = fnv1a(&binding.descriptorCount, sizeof(binding.descriptorCount), hash);
+		hash = fnv1a(&stageFlags, sizeof(stageFlags), hash);
+		hash = fnv1a(&binding.pImmutableSamplers, sizeof(binding.pImmutableSamplers), hash);
+	}
+
+	vector<Entry>& entries = layouts[hash];
+	for (const Entry& entry : entries)
+	{
+		if (std::equal(entry.bindings.begin(), entry.bindings.end(), sorted.begin(), sorted.end(), sameBinding))
+		{
+			return entry.layout.get();
+		}
+	}
+
+	vk::DescriptorSetLayoutCreateInfo layoutCI;
+	layoutCI.bindingCount = static_cast<uint32_t>(sorted.size());
+	layoutCI.pBindings = sorted.data();
+
+	Entry entry;
+	entry.layout = device.createDescriptorSetLayoutUnique(layoutCI);
+	entry.bindings = std::move(sorted);
+	entries.push_back(std::move(entry));
+	return entries.back().layout.get();
+}
+
+void DescriptorAllocator::init(vk::Device device, uint32_t setsPerPool)
+{
+	this->device = device;
+	pools.clear();
+	current = 0;
+	nextSetCount = std::clamp(setsPerPool, 1u, maxSetsPerPool);
+}
+
+vk::DescriptorSet DescriptorAllocator::allocate(vk::DescriptorSetLayout layout)
+{
+	vk::DescriptorSetAllocateInfo allocInfo;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	while (true)
+	{
+		bool newPool = current == pools.size();
+		if (newPool)
+		{
+			pools.push_back(createPool(nextSetCount));
+			nextSetCount = std::min(nextSetCount * 2, maxSetsPerPool);
+		}
+
+		allocInfo.descriptorPool = pools[current].get();
+		try
+		{
+			return device.allocateDescriptorSets(allocInfo)[0];
+		}
+		// 作ったばかりのプールに入らないなら、レイアウトがプールの大きさを超えている
+		catch (const vk::OutOfPoolMemoryError&)
+		{
+			if (newPool)
+			{
+				throw;
+			}
+		}
+		catch (const vk::FragmentedPoolError&)
+		{
+			if (newPool)
+			{
+				throw;
+			}
+		}
+		current++;
+	}
+}
+
+vk::UniqueDescriptorPool DescriptorAllocator::createPool(uint32_t setCount)
+{
+	vk::DescriptorPoolSize poolSizes[std::size(poolSizeRatios)];
+	for (size_t i = 0; i < std::size(poolSizeRatios); i++)
+	{
+		poolSizes[i].type = poolSizeRatios[i].type;
+		poolSizes[i].descriptorCount = static_cast<uint32_t>(poolSizeRatios[i].ratio * setCount);
+	}
+
+	// セットは個別に解放しないのでeFreeDescriptorSetは付けない
+	vk::DescriptorPoolCreateInfo poolCI;
+	poolCI.maxSets = setCount;
+	poolCI.poolSizeCount = static_cast<uint32_t>(std::size(poolSizes));
+	poolCI.pPoolSizes = poolSizes;
+	return device.createDescriptorPoolUnique(poolCI);
+}
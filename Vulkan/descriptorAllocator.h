@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <unordered_map>
+
+using namespace std;
+
+// DescriptorSetLayoutをバインディングの並びのハッシュで共有する
+// 同じバインディングを渡せば同じレイアウトが返るので、呼び出し側は破棄を気にしなくてよい
+class DescriptorLayoutCache
+{
+public:
+	void init(vk::Device device);
+
+	// バインディングの順番は問わない。イミュータブルサンプラーはポインタの値で区別する
+	vk::DescriptorSetLayout get(vk::ArrayProxy<const vk::DescriptorSetLayoutBinding> bindings);
+
+private:
+	struct Entry
+	{
+		vector<vk::DescriptorSetLayoutBinding> bindings; // binding番号の順
+		vk::UniqueDescriptorSetLayout layout;
+	};
+
+	vk::Device device;
+	unordered_map<uint64_t, vector<Entry>> layouts; // ハッシュが衝突したものは同じ要素に並べる
+};
+
+// ディスクリプタセットをプールから切り出す。セットを個別に解放しないので断片化しない
+// プールが足りなくなったら倍の大きさのプールを足して、そこから切り出し直す
+class DescriptorAllocator
+{
+public:
+	// setsPerPoolは最初のプールの大きさ
+	void init(vk::Device device, uint32_t setsPerPool = 64);
+
+	// 破棄までずっと使うセット
+	vk::DescriptorSet allocate(vk::DescriptorSetLayout layout);
+
+private:
+	vk::UniqueDescriptorPool createPool(uint32_t setCount);
+
+	vk::Device device;
+	vector<vk::UniqueDescriptorPool> pools;
+	uint32_t current = 0; // 切り出しに使っているプール。前のものは使い切った
+	uint32_t nextSetCount = 0;
+};
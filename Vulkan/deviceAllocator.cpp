@@ -0,0 +1,230 @@
+#include "deviceAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+void DeviceAllocator::init(vk::PhysicalDevice physicalDevice, vk::Device device, vk::DeviceSize blockSize)
+{
+	this->device = device;
+	this->blockSize = blockSize;
+	memProps = physicalDevice.getMemoryProperties();
+	nonCoherentAtomSize = physicalDevice.getProperties().limits.nonCoherentAtomSize;
+	pools.resize(size_t(memProps.memoryTypeCount) * 2);
+}
+
+namespace
+{
+	uint32_t countBits(vk::MemoryPropertyFlags flags)
+	{
+		uint32_t bits = static_cast<VkMemoryPropertyFlags>(flags);
+		uint32_t count = 0;
+		for (; bits != 0; bits &= bits - 1)
+		{
+			count++;
+		}
+		return count;
+	}
+}
+
+optional<uint32_t> DeviceAllocator::findMemoryType(uint32_t memoryTypeBits, const MemoryUsage& usage) const
+{
+	optional<uint32_t> best;
+	int bestScore = INT32_MIN;
+
+	for (uint32_t i = 0; i < memProps.memoryTypeCount; i++)
+	{
+		vk::MemoryPropertyFlags flags = memProps.memoryTypes[i].propertyFlags;
+		if (!(memoryTypeBits & (1u << i)) || (flags & usage.required) != usage.required)
+		{
+			continue;
+		}
+
+		// 同点ならドライバが先に並べたタイプを使う
+		int score = int(countBits(flags & usage.preferred)) - int(countBits(flags & usage.avoid));
+		if (score > bestScore)
+		{
+			best = i;
+			bestScore = score;
+		}
+	}
+	return best;
+}
+
+bool DeviceAllocator::hasLargeHostVisibleDeviceLocalHeap() const
+{
+	// 従来のBAR領域は256MiBなので、それより大きければCPUから直接書き込んでよい
+	const vk::DeviceSize legacyBarSize = 256ull * 1024 * 1024;
+	vk::MemoryPropertyFlags wanted = vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible;
+
+	for (uint32_t i = 0; i < memProps.memoryTypeCount; i++)
+	{
+		const vk::MemoryType& type = memProps.memoryTypes[i];
+		if ((type.propertyFlags & wanted) == wanted && memProps.memoryHeaps[type.heapIndex].size > legacyBarSize)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DeviceAllocator::isCoherent(uint32_t memoryTypeIndex) const
+{
+	return bool(memProps.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+}
+
+uint32_t DeviceAllocator::createBlock(Pool& pool, uint32_t memoryTypeIndex, vk::DeviceSize size, bool dedicated)
+{
+	vk::MemoryAllocateInfo memAlloc;
+	memAlloc.allocationSize = size;
+	memAlloc.memoryTypeIndex = memoryTypeIndex;
+
+	Block block;
+	block.memory = device.allocateMemoryUnique(memAlloc);
+	allocationCount++;
+
+	if (!dedicated)
+	{
+		block.tlsf = make_unique<TlsfAllocator>(size);
+	}
+
+	// ホストから見えるブロックは作成時に一度だけマップしておく
+	if (memProps.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+	{
+		block.mapped = device.mapMemory(block.memory.get(), 0, VK_WHOLE_SIZE);
+	}
+
+	// 空いている場所があれば再利用する
+	for (uint32_t i = 0; i < pool.blocks.size(); i++)
+	{
+		if (!pool.blocks[i].memory)
+		{
+			pool.blocks[i] = std::move(block);
+			return i;
+		}
+	}
+	pool.blocks.push_back(std::move(block));
+	return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+DeviceAllocation DeviceAllocator::allocate(const vk::MemoryRequirements& memReq, uint32_t memoryTypeIndex, bool linear)
+{
+	uint32_t poolIndex = memoryTypeIndex * 2 + (linear ? 0 : 1);
+	Pool& pool = pools[poolIndex];
+
+	vk::DeviceSize size = memReq.size;
+	vk::DeviceSize alignment = std::max<vk::DeviceSize>(memReq.alignment, 1);
+
+	// 非コヒーレントなメモリはフラッシュ範囲が他の割り当てにかからないようにする
+	bool hostVisible = bool(memProps.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+	if (hostVisible && !isCoherent(memoryTypeIndex))
+	{
+		alignment = std::max(alignment, nonCoherentAtomSize);
+		size = (size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+	}
+
+	DeviceAllocation allocation;
+	allocation.memoryTypeIndex = memoryTypeIndex;
+	allocation.pool = poolIndex;
+	allocation.size = memReq.size;
+
+	// ブロックの半分を超えるものは専用のメモリにする
+	if (size > blockSize / 2)
+	{
+		allocation.block = createBlock(pool, memoryTypeIndex, size, true);
+		allocation.memory = pool.blocks[allocation.block].memory.get();
+		allocation.offset = 0;
+		allocation.mapped = pool.blocks[allocation.block].mapped;
+		return allocation;
+	}
+
+	TlsfAllocator::Allocation range;
+	uint32_t blockIndex = UINT32_MAX;
+	for (uint32_t i = 0; i < pool.blocks.size(); i++)
+	{
+		Block& block = pool.blocks[i];
+		if (block.tlsf && block.tlsf->allocate(size, alignment, range))
+		{
+			blockIndex = i;
+			break;
+		}
+	}
+
+	if (blockIndex == UINT32_MAX)
+	{
+		blockIndex = createBlock(pool, memoryTypeIndex, blockSize, false);
+		if (!pool.blocks[blockIndex].tlsf->allocate(size, alignment, range))
+		{
+			throw runtime_error("failed to sub-allocate device memory!");
+		}
+	}
+
+	Block& block = pool.blocks[blockIndex];
+	allocation.block = blockIndex;
+	allocation.node = range.node;
+	allocation.memory = block.memory.get();
+	allocation.offset = range.offset;
+	allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + range.offset : nullptr;
+	return allocation;
+}
+
+void DeviceAllocator::free(const DeviceAllocation& allocation)
+{
+	if (allocation.pool >= pools.size())
+	{
+		return;
+	}
+	Pool& pool = pools[allocation.pool];
+	Block& block = pool.blocks[allocation.block];
+
+	if (!block.tlsf)
+	{
+		block = Block{};
+		return;
+	}
+
+	block.tlsf->free(allocation.node);
+
+	// 空になったブロックは1つだけ残して解放する
+	if (block.tlsf->isEmpty())
+	{
+		size_t emptyBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(),
+			[](const Block& b) { return b.tlsf && b.tlsf->isEmpty(); });
+		if (emptyBlocks > 1)
+		{
+			block = Block{};
+		}
+	}
+}
+
+vk::MappedMemoryRange DeviceAllocator::alignedRange(const DeviceAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const
+{
+	if (size == VK_WHOLE_SIZE)
+	{
+		size = allocation.size - offset;
+	}
+	vk::DeviceSize begin = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+	vk::DeviceSize end = (allocation.offset + offset + size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+
+	vk::MappedMemoryRange range;
+	range.memory = allocation.memory;
+	range.offset = begin;
+	range.size = end - begin;
+	return range;
+}
+
+void DeviceAllocator::flush(const DeviceAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size)
+{
+	if (isCoherent(allocation.memoryTypeIndex))
+	{
+		return;
+	}
+	device.flushMappedMemoryRanges({ alignedRange(allocation, offset, size) });
+}
+
+void DeviceAllocator::invalidate(const DeviceAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size)
+{
+	if (isCoherent(allocation.memoryTypeIndex))
+	{
+		return;
+	}
+	device.invalidateMappedMemoryRanges({ alignedRange(allocation, offset, size) });
+}
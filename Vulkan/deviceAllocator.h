@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <memory>
+#include <optional>
+#include "tlsf.h"
+
+using namespace std;
+
+// メモリタイプの選び方。requiredは必須、preferredは多く持つほど、avoidは持たないほど優先する
+struct MemoryUsage
+{
+	vk::MemoryPropertyFlags required;
+	vk::MemoryPropertyFlags preferred;
+	vk::MemoryPropertyFlags avoid;
+};
+
+struct DeviceAllocation
+{
+	vk::DeviceMemory memory;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+	void* mapped = nullptr; // HOST_VISIBLEなら常にマップされている
+	uint32_t memoryTypeIndex = 0;
+	uint32_t pool = UINT32_MAX;
+	uint32_t block = UINT32_MAX;
+	uint32_t node = TlsfAllocator::invalidNode;
+};
+
+// メモリタイプごとの大きなブロックからTLSFでバッファやイメージの領域を切り出す
+// バッファ（リニア）とイメージ（オプティマル）はブロックを分けるのでbufferImageGranularityを気にしなくてよい
+class DeviceAllocator
+{
+public:
+	void init(vk::PhysicalDevice physicalDevice, vk::Device device, vk::DeviceSize blockSize = 64ull * 1024 * 1024);
+
+	optional<uint32_t> findMemoryType(uint32_t memoryTypeBits, const MemoryUsage& usage) const;
+	// ReBARや統合GPUのように、大きなDEVICE_LOCAL|HOST_VISIBLEのヒープがあるか
+	bool hasLargeHostVisibleDeviceLocalHeap() const;
+	bool isCoherent(uint32_t memoryTypeIndex) const;
+
+	DeviceAllocation allocate(const vk::MemoryRequirements& memReq, uint32_t memoryTypeIndex, bool linear);
+	void free(const DeviceAllocation& allocation);
+
+	// 非コヒーレントなメモリだけnonCoherentAtomSizeに揃えてフラッシュ/無効化する
+	void flush(const DeviceAllocation& allocation, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+	void invalidate(const DeviceAllocation& allocation, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+
+	uint32_t getAllocationCount() const { return allocationCount; } // vkAllocateMemoryの回数
+
+private:
+	struct Block
+	{
+		vk::UniqueDeviceMemory memory;
+		unique_ptr<TlsfAllocator> tlsf; // 専用の割り当てならnullptr
+		void* mapped = nullptr;
+	};
+
+	struct Pool
+	{
+		vector<Block> blocks;
+	};
+
+	vk::MappedMemoryRange alignedRange(const DeviceAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const;
+	uint32_t createBlock(Pool& pool, uint32_t memoryTypeIndex, vk::DeviceSize size, bool dedicated);
+
+	vk::Device device;
+	vk::PhysicalDeviceMemoryProperties memProps;
+	vk::DeviceSize blockSize = 0;
+	vk::DeviceSize nonCoherentAtomSize = 1;
+	uint32_t allocationCount = 0;
+	vector<Pool> pools; // メモリタイプ×{リニア, オプティマル}
+};
+
+// 破棄時に領域をアロケータへ返す
+class UniqueAllocation
+{
+public:
+	UniqueAllocation() = default;
+	UniqueAllocation(DeviceAllocator* owner, const DeviceAllocation& allocation) : owner(owner), allocation(allocation) {}
+	UniqueAllocation(const UniqueAllocation&) = delete;
+	UniqueAllocation& operator=(const UniqueAllocation&) = delete;
+	UniqueAllocation(UniqueAllocation&& other) noexcept : owner(other.owner), allocation(other.allocation) { other.owner = nullptr; }
+	UniqueAllocation& operator=(UniqueAllocation&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			owner = other.owner;
+			allocation = other.allocation;
+			other.owner = nullptr;
+		}
+		return *this;
+	}
+	~UniqueAllocation() { reset(); }
+
+	void reset()
+	{
+		if (owner)
+		{
+			owner->free(allocation);
+			owner = nullptr;
+		}
+		allocation = DeviceAllocation{};
+	}
+
+	const DeviceAllocation& get() const { return allocation; }
+	const DeviceAllocation* operator->() const { return &allocation; }
+	explicit operator bool() const { return owner != nullptr; }
+
+private:
+	DeviceAllocator* owner = nullptr;
+	DeviceAllocation allocation;
+};
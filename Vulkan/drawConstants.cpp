@@ -0,0 +1,31 @@
+#include "drawConstants.h"
+#include <cstring>
+#include <stdexcept>
+
+void DrawConstants::init(const vk::PhysicalDeviceLimits& limits, uint32_t size, vk::ShaderStageFlags stages, bool allowPushConstants)
+{
+	// プッシュ定数の大きさは4の倍数でなければならない
+	if (size == 0 || size % 4 != 0)
+	{
+		throw runtime_error("draw constants size must be a non-zero multiple of 4");
+	}
+	pushConstants = allowPushConstants && size <= limits.maxPushConstantsSize;
+
+	range.stageFlags = stages;
+	range.offset = 0;
+	range.size = size;
+}
+
+void DrawConstants::set(vk::CommandBuffer commandBuffer, vk::PipelineLayout layout, FrameAllocator& frameAllocator,
+	vk::DescriptorSet set, uint32_t setIndex, const void* data) const
+{
+	if (pushConstants)
+	{
+		commandBuffer.pushConstants(layout, range.stageFlags, 0, range.size, data);
+		return;
+	}
+
+	FrameAllocator::Allocation allocation = frameAllocator.allocate(range.size);
+	std::memcpy(allocation.mapped, data, range.size);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, setIndex, { set }, { allocation.offset });
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include "frameAllocator.h"
+
+using namespace std;
+
+// 描画ごとの小さな定数の渡し方を選ぶ
+// maxPushConstantsSizeに収まればプッシュ定数で、メモリへの書き込みもディスクリプタのバインドもない
+// 収まらなければフレームアロケータに置き、動的オフセット付きでuniformのセットをバインドし直す
+// シェーダーはどちらの場合もブロックの中身が同じで、宣言だけが違う変種を使う
+class DrawConstants
+{
+public:
+	// sizeは4の倍数
+	void init(const vk::PhysicalDeviceLimits& limits, uint32_t size, vk::ShaderStageFlags stages, bool allowPushConstants);
+
+	bool usesPushConstants() const { return pushConstants; }
+	// パイプラインレイアウトに渡す範囲。uniformで渡すときはcountが0
+	const vk::PushConstantRange* getPushConstantRange() const { return pushConstants ? &range : nullptr; }
+	uint32_t getPushConstantRangeCount() const { return pushConstants ? 1 : 0; }
+	// パイプラインをバインドした後に呼ぶ。dataはinitのsizeバイト
+	// uniformで渡すときはsetIndexにsetをバインドする。setの最初の動的uniformがこの定数を指していること
+	void set(vk::CommandBuffer commandBuffer, vk::PipelineLayout layout, FrameAllocator& frameAllocator,
+		vk::DescriptorSet set, uint32_t setIndex, const void* data) const;
+
+	template<class T>
+	void set(vk::CommandBuffer commandBuffer, vk::PipelineLayout layout, FrameAllocator& frameAllocator,
+		vk::DescriptorSet set, uint32_t setIndex, const T& value) const
+	{
+		this->set(commandBuffer, layout, frameAllocator, set, setIndex, static_cast<const void*>(&value));
+	}
+
+private:
+	bool pushConstants = false;
+	vk::PushConstantRange range;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include "geometryArena.h"
+#include "vertex.h"
+
+// 描画する1メッシュ分。普通のメッシュはidentityInstanceを1つだけ使う
+struct MeshDraw
+{
+	MeshHandle mesh;
+	uint32_t firstInstance = 0;
+	uint32_t instanceCount = 1;
+	Vec2 boundsCenter = { 0.0f, 0.0f }; // メッシュ空間での外接円。GPUカリングで使う
+	float boundsRadius = 0.0f;
+};
+
+// 同じページとインデックスの型が続く間接描画コマンドの並び。1回のdrawIndexedIndirectで描く
+struct IndirectDrawBatch
+{
+	uint32_t page;
+	vk::IndexType indexType;
+	uint32_t firstCommand;
+	uint32_t commandCount;
+};
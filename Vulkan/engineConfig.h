@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include "vertexFormat.h"
+
+struct EngineConfig
+{
+	uint32_t framesInFlight = 2; // CPUとGPUで同時に処理するフレーム数
+	bool headless = false; // ウィンドウとサーフェスを使わずオフスクリーンに描画する
+	uint32_t frameCount = 0; // 描画するフレーム数（0なら終了するまで）
+	bool readback = false; // オフスクリーンの描画結果をホストに読み戻す。最後の2フレームは同じ入力で描いて一致を確かめる
+	const char* readbackFile = nullptr; // 最後のフレームを書き出すPPMファイル
+	uint64_t stagingBufferSize = 64ull * 1024 * 1024; // 常にマップしておくステージングリングの大きさ
+	uint64_t frameAllocatorSize = 1ull * 1024 * 1024; // 1フレームで使い捨てるuniformや頂点の上限
+	uint32_t arenaVertexCount = 1u << 20; // 共有頂点バッファの1ページあたりの頂点数
+	uint32_t arenaIndexCount = 1u << 22; // 共有インデックスバッファの1ページあたりのインデックス数
+	bool optimizeMeshes = true; // 転送前に三角形と頂点を並べ替える（重なった三角形の描画順が変わりうる）
+	VertexFormat vertexFormat = VertexFormat::Float32; // GPUに置く頂点の形式。対応していなければFloat32に戻す
+	bool indirectDraws = true; // 描画コマンドをバッファに書いてdrawIndexedIndirectで描く
+	bool gpuCulling = true; // コンピュートシェーダで画面外のインスタンスを除いてからdrawIndexedIndirectCountで描く
+	bool pushConstants = true; // 描画ごとの定数がmaxPushConstantsSizeに収まればuniformの代わりにプッシュ定数で渡す
+	bool asyncTransfer = true; // 転送専用のキューファミリーがあれば転送をそこで行う
+	const char* pipelineCacheFile = "pipeline_cache.bin"; // 起動時に読み込み終了時に保存するパイプラインキャッシュ（nullptrなら使わない）
+	const char* profileFile = nullptr; // フレーム区間の計測結果の出力先（.jsonならJSON、それ以外はCSV）
+};
@@ -0,0 +1,69 @@
+#include "frameAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+void FrameAllocator::init(vk::PhysicalDevice physicalDevice, vk::Device device, DeviceAllocator& allocator, uint32_t framesInFlight, vk::DeviceSize bytesPerFrame)
+{
+	this->allocator = &allocator;
+
+	// フレームの境目もフラッシュの単位に揃えておくと、隣のフレームの領域を巻き込まない
+	const vk::PhysicalDeviceLimits& limits = physicalDevice.getProperties().limits;
+	defaultAlignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+	vk::DeviceSize frameAlignment = std::max(defaultAlignment, limits.nonCoherentAtomSize);
+	frameSize = (bytesPerFrame + frameAlignment - 1) / frameAlignment * frameAlignment;
+	if (frameSize * framesInFlight > UINT32_MAX)
+	{
+		throw runtime_error("frame allocator is too large for dynamic offsets!");
+	}
+
+	vk::BufferCreateInfo bufferCI;
+	bufferCI.size = frameSize * framesInFlight;
+	bufferCI.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer;
+	bufferCI.sharingMode = vk::SharingMode::eExclusive;
+	buffer = device.createBufferUnique(bufferCI);
+
+	// 毎フレーム書き換えるのでコヒーレントなメモリにしてフラッシュを不要にする
+	MemoryUsage usage = { vk::MemoryPropertyFlagBits::eHostVisible, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlagBits::eHostCached };
+	vk::MemoryRequirements memReq = device.getBufferMemoryRequirements(buffer.get());
+	optional<uint32_t> memoryTypeIndex = allocator.findMemoryType(memReq.memoryTypeBits, usage);
+	if (!memoryTypeIndex.has_value())
+	{
+		throw runtime_error("failed to find a suitable memory type for the frame allocator!");
+	}
+
+	memory = UniqueAllocation(&allocator, allocator.allocate(memReq, memoryTypeIndex.value(), true));
+	device.bindBufferMemory(buffer.get(), memory->memory, memory->offset);
+	mapped = static_cast<char*>(memory->mapped);
+}
+
+void FrameAllocator::beginFrame(uint32_t frameIndex)
+{
+	frameBegin = frameSize * frameIndex;
+	head = frameBegin;
+}
+
+void FrameAllocator::endFrame()
+{
+	if (head > frameBegin)
+	{
+		allocator->flush(memory.get(), frameBegin, head - frameBegin);
+	}
+}
+
+FrameAllocator::Allocation FrameAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+	if (alignment == 0)
+	{
+		alignment = defaultAlignment;
+	}
+
+	vk::DeviceSize offset = (head + alignment - 1) / alignment * alignment;
+	if (offset + size > frameBegin + frameSize)
+	{
+		throw runtime_error("frame allocator is out of memory for this frame!");
+	}
+	head = offset + size;
+
+	return Allocation{ buffer.get(), static_cast<uint32_t>(offset), size, mapped + offset };
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstring>
+#include <vector>
+#include "deviceAllocator.h"
+
+using namespace std;
+
+// 常にマップした1本のバッファをフレームごとの領域に分け、その中でポインタを進めるだけで切り出す
+// 領域はフレームのfenceを待った後のbeginFrame()でまとめて空にするので、個別の解放はない
+// 切り出した位置は動的オフセットとして渡すので、ディスクリプタセットを書き換えなくてよい
+class FrameAllocator
+{
+public:
+	struct Allocation
+	{
+		vk::Buffer buffer;
+		uint32_t offset = 0; // バッファの先頭から。動的オフセットにそのまま使える
+		vk::DeviceSize size = 0;
+		void* mapped = nullptr;
+	};
+
+	// uniform・storage・頂点・インデックスのどれとしても使えるバッファを作る
+	void init(vk::PhysicalDevice physicalDevice, vk::Device device, DeviceAllocator& allocator, uint32_t framesInFlight, vk::DeviceSize bytesPerFrame);
+
+	// このフレームのfenceを待った後に呼ぶ
+	void beginFrame(uint32_t frameIndex);
+	// 非コヒーレントなメモリなら書いた範囲をフラッシュする。提出の前に呼ぶ
+	void endFrame();
+
+	// alignmentが0ならuniformとstorageのオフセットのアライメントの大きい方。足りなければruntime_error
+	Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment = 0);
+
+	template<class T>
+	Allocation push(const T& value)
+	{
+		Allocation allocation = allocate(sizeof(T));
+		std::memcpy(allocation.mapped, &value, sizeof(T));
+		return allocation;
+	}
+
+	vk::Buffer getBuffer() const { return buffer.get(); }
+	vk::DeviceSize getUsedBytes() const { return head - frameBegin; } // このフレームで使った量
+
+private:
+	DeviceAllocator* allocator = nullptr;
+	vk::DeviceSize frameSize = 0;
+	vk::DeviceSize defaultAlignment = 1;
+	vk::DeviceSize frameBegin = 0;
+	vk::DeviceSize head = 0;
+	UniqueAllocation memory; // バッファより先に宣言する
+	vk::UniqueBuffer buffer;
+	char* mapped = nullptr;
+};
@@ -0,0 +1,149 @@
+#include "geometryArena.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void GeometryArena::init(vk::Device device, DeviceAllocator& allocator, UploadContext& uploadContext, const MemoryUsage& memoryUsage,
+	vk::DeviceSize vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	this->device = device;
+	this->allocator = &allocator;
+	this->uploadContext = &uploadContext;
+	this->memoryUsage = memoryUsage;
+	this->vertexStride = vertexStride;
+	this->vertexCapacity = vertexCapacity;
+	this->indexCapacity = indexCapacity;
+}
+
+void GeometryArena::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::UniqueBuffer& buffer, UniqueAllocation& memory)
+{
+	vk::BufferCreateInfo bufferCI;
+	bufferCI.size = size;
+	bufferCI.usage = usage | vk::BufferUsageFlagBits::eTransferDst;
+	bufferCI.sharingMode = vk::SharingMode::eExclusive;
+
+	buffer = device.createBufferUnique(bufferCI);
+
+	vk::MemoryRequirements memReq = device.getBufferMemoryRequirements(buffer.get());
+	optional<uint32_t> memoryTypeIndex = allocator->findMemoryType(memReq.memoryTypeBits, memoryUsage);
+	if (!memoryTypeIndex.has_value())
+	{
+		throw runtime_error("failed to find a suitable memory type for the geometry arena!");
+	}
+
+	memory = UniqueAllocation(allocator, allocator->allocate(memReq, memoryTypeIndex.value(), true));
+	device.bindBufferMemory(buffer.get(), memory->memory, memory->offset);
+}
+
+void GeometryArena::createPage(uint32_t vertexCount, uint32_t indexCount)
+{
+	// 既定の大きさに収まらないメッシュにはそれ専用の大きさのページを作る
+	vertexCount = std::max(vertexCount, vertexCapacity);
+	indexCount = std::max(indexCount, indexCapacity);
+
+	Page page;
+	createBuffer(vertexStride * vertexCount, vk::BufferUsageFlagBits::eVertexBuffer, page.vertexBuffer, page.vertexMemory);
+	createBuffer(sizeof(uint16_t) * indexCount, vk::BufferUsageFlagBits::eIndexBuffer, page.index16Buffer, page.index16Memory);
+	createBuffer(sizeof(uint32_t) * indexCount, vk::BufferUsageFlagBits::eIndexBuffer, page.index32Buffer, page.index32Memory);
+	page.vertices = TlsfAllocator(vertexCount);
+	page.indices16 = TlsfAllocator(indexCount);
+	page.indices32 = TlsfAllocator(indexCount);
+	pages.push_back(std::move(page));
+}
+
+void GeometryArena::write(vk::Buffer buffer, const UniqueAllocation& memory, vk::DeviceSize offset, const void* data, vk::DeviceSize size)
+{
+	// CPUから見えるデバイスローカルのメモリならステージングを省く
+	if (memory->mapped)
+	{
+		memcpy(static_cast<char*>(memory->mapped) + offset, data, size);
+		allocator->flush(memory.get(), offset, size);
+		return;
+	}
+
+	uploadContext->copyToBuffer(buffer, offset, data, size);
+}
+
+MeshHandle GeometryArena::addMesh(const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount, vk::IndexType indexType)
+{
+	// TLSFは大きさ0の領域を切り出せない
+	if (vertexCount == 0 || indexCount == 0)
+	{
+		return MeshHandle{};
+	}
+
+	TlsfAllocator::Allocation vertexAlloc;
+	TlsfAllocator::Allocation indexAlloc;
+
+	uint32_t pageIndex = 0;
+	for (; pageIndex < pages.size(); pageIndex++)
+	{
+		Page& page = pages[pageIndex];
+		if (!page.vertices.allocate(vertexCount, 1, vertexAlloc))
+		{
+			continue;
+		}
+		if (!page.indices(indexType).allocate(indexCount, 1, indexAlloc))
+		{
+			page.vertices.free(vertexAlloc.node);
+			continue;
+		}
+		break;
+	}
+
+	if (pageIndex == pages.size())
+	{
+		createPage(vertexCount, indexCount);
+		if (!pages.back().vertices.allocate(vertexCount, 1, vertexAlloc) || !pages.back().indices(indexType).allocate(indexCount, 1, indexAlloc))
+		{
+			throw runtime_error("failed to allocate a mesh from a new geometry arena page!");
+		}
+	}
+
+	Page& page = pages[pageIndex];
+	write(page.vertexBuffer.get(), page.vertexMemory, vertexAlloc.offset * vertexStride, vertices, vertexStride * vertexCount);
+	if (indexType == vk::IndexType::eUint16)
+	{
+		write(page.index16Buffer.get(), page.index16Memory, indexAlloc.offset * sizeof(uint16_t), indices, sizeof(uint16_t) * indexCount);
+	}
+	else
+	{
+		write(page.index32Buffer.get(), page.index32Memory, indexAlloc.offset * sizeof(uint32_t), indices, sizeof(uint32_t) * indexCount);
+	}
+
+	MeshHandle mesh;
+	mesh.page = pageIndex;
+	mesh.firstIndex = static_cast<uint32_t>(indexAlloc.offset);
+	mesh.indexCount = indexCount;
+	mesh.vertexOffset = static_cast<int32_t>(vertexAlloc.offset);
+	mesh.indexType = indexType;
+	mesh.vertexNode = vertexAlloc.node;
+	mesh.indexNode = indexAlloc.node;
+	return mesh;
+}
+
+void GeometryArena::removeMesh(const MeshHandle& mesh)
+{
+	if (mesh.empty())
+	{
+		return;
+	}
+	Page& page = pages[mesh.page];
+	page.vertices.free(mesh.vertexNode);
+	page.indices(mesh.indexType).free(mesh.indexNode);
+}
+
+void GeometryArena::bindVertices(vk::CommandBuffer commandBuffer, uint32_t page) const
+{
+	commandBuffer.bindVertexBuffers(0, { pages[page].vertexBuffer.get() }, { 0 });
+}
+
+void GeometryArena::bindIndices(vk::CommandBuffer commandBuffer, uint32_t page, vk::IndexType indexType) const
+{
+	if (indexType == vk::IndexType::eUint16)
+	{
+		commandBuffer.bindIndexBuffer(pages[page].index16Buffer.get(), 0, vk::IndexType::eUint16);
+		return;
+	}
+	commandBuffer.bindIndexBuffer(pages[page].index32Buffer.get(), 0, vk::IndexType::eUint32);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include "deviceAllocator.h"
+#include "tlsf.h"
+#include "uploadContext.h"
+
+using namespace std;
+
+// 複数のメッシュが共有する頂点/インデックスバッファ内の範囲
+// drawIndexedのfirstIndexとvertexOffsetにそのまま渡せる
+struct MeshHandle
+{
+	uint32_t page = UINT32_MAX;
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	int32_t vertexOffset = 0;
+	vk::IndexType indexType = vk::IndexType::eUint32; // firstIndexはこの型のインデックスバッファ内の位置
+	uint32_t vertexNode = TlsfAllocator::invalidNode;
+	uint32_t indexNode = TlsfAllocator::invalidNode;
+
+	bool empty() const { return page == UINT32_MAX; } // 頂点かインデックスがなく、何も確保していない
+};
+
+// 大きな頂点バッファとインデックスバッファの組（ページ）から、メッシュごとの範囲を要素単位でTLSFで切り出す
+// インデックスバッファは16ビットと32ビットで別々に持つ
+// ページが一杯になったら次のページを作るので、バインドし直すのはページが変わるときだけでよい
+class GeometryArena
+{
+public:
+	void init(vk::Device device, DeviceAllocator& allocator, UploadContext& uploadContext, const MemoryUsage& memoryUsage,
+		vk::DeviceSize vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity);
+
+	// 頂点かインデックスが0個なら何も確保せず空のハンドルを返す
+	MeshHandle addMesh(const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount, vk::IndexType indexType);
+	// GPUが使い終わってから呼ぶこと
+	void removeMesh(const MeshHandle& mesh);
+
+	void bindVertices(vk::CommandBuffer commandBuffer, uint32_t page) const;
+	void bindIndices(vk::CommandBuffer commandBuffer, uint32_t page, vk::IndexType indexType) const;
+	uint32_t getPageCount() const { return static_cast<uint32_t>(pages.size()); }
+
+private:
+	struct Page
+	{
+		// バッファを先に破棄するためメモリを先に宣言する
+		UniqueAllocation vertexMemory;
+		UniqueAllocation index16Memory;
+		UniqueAllocation index32Memory;
+		vk::UniqueBuffer vertexBuffer;
+		vk::UniqueBuffer index16Buffer;
+		vk::UniqueBuffer index32Buffer;
+		TlsfAllocator vertices; // 単位は頂点
+		TlsfAllocator indices16; // 単位はインデックス
+		TlsfAllocator indices32;
+
+		TlsfAllocator& indices(vk::IndexType type) { return type == vk::IndexType::eUint16 ? indices16 : indices32; }
+	};
+
+	void createPage(uint32_t vertexCount, uint32_t indexCount);
+	void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::UniqueBuffer& buffer, UniqueAllocation& memory);
+	void write(vk::Buffer buffer, const UniqueAllocation& memory, vk::DeviceSize offset, const void* data, vk::DeviceSize size);
+
+	vk::Device device;
+	DeviceAllocator* allocator = nullptr;
+	UploadContext* uploadContext = nullptr;
+	MemoryUsage memoryUsage;
+	vk::DeviceSize vertexStride = 0;
+	uint32_t vertexCapacity = 0;
+	uint32_t indexCapacity = 0;
+	vector<Page> pages;
+};
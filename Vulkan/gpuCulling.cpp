@@ -0,0 +1,241 @@
+#include "gpuCulling.h"
+#include "instanceData.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	constexpr uint32_t localSize = 64; // cull.compのlocal_size_xとblockSize
+	constexpr uint32_t bindingCount = 8;
+}
+
+void GpuCulling::init(vk::PhysicalDevice physicalDevice, vk::Device device, DeviceAllocator& allocator, UploadContext& uploadContext,
+	const MemoryUsage& inputMemoryUsage, vk::ShaderModule shader, PipelineManager& pipelineManager,
+	DescriptorLayoutCache& layoutCache, DescriptorAllocator& descriptorAllocator,
+	const vector<MeshDraw>& draws, const vector<IndirectDrawBatch>& batches, vk::Buffer instanceBuffer, vk::Buffer commandBuffer)
+{
+	this->device = device;
+	this->allocator = &allocator;
+	this->uploadContext = &uploadContext;
+	this->pipelineManager = &pipelineManager;
+	maxGroupCount = std::max(physicalDevice.getProperties().limits.maxComputeWorkGroupCount[0], 1u);
+	drawCount = static_cast<uint32_t>(draws.size());
+	batchCount = static_cast<uint32_t>(batches.size());
+
+	// 描画ごとに見えたインスタンスを詰める領域を、元のインスタンスの数だけ確保する
+	// バッチは描画の順に並んでいるので、outputBaseはその描画の最初のオブジェクトの番号と同じになる
+	vector<DrawInfo> drawInfos(draws.size());
+	objectCount = 0;
+	for (uint32_t b = 0; b < batches.size(); b++)
+	{
+		for (uint32_t i = 0; i < batches[b].commandCount; i++)
+		{
+			uint32_t d = batches[b].firstCommand + i;
+			drawInfos[d] = DrawInfo{ draws[d].boundsCenter, draws[d].boundsRadius, b, objectCount, batches[b].firstCommand, draws[d].instanceCount, 0 };
+			objectCount += draws[d].instanceCount;
+		}
+	}
+
+	vector<uint32_t> objects;
+	objects.reserve(size_t(objectCount) * 2);
+	for (uint32_t d = 0; d < draws.size(); d++)
+	{
+		for (uint32_t i = 0; i < draws[d].instanceCount; i++)
+		{
+			objects.push_back(d);
+			objects.push_back(draws[d].firstInstance + i);
+		}
+	}
+
+	// GPUだけが読み書きするバッファはCPUから見えないメモリに置く
+	MemoryUsage outputMemoryUsage = { vk::MemoryPropertyFlagBits::eDeviceLocal, {}, vk::MemoryPropertyFlagBits::eHostVisible };
+
+	vk::DeviceSize objectSize = sizeof(uint32_t) * std::max<size_t>(objects.size(), 2);
+	vk::DeviceSize drawInfoSize = sizeof(DrawInfo) * std::max<size_t>(drawInfos.size(), 1);
+	createBuffer(objectSize, vk::BufferUsageFlagBits::eStorageBuffer, inputMemoryUsage, objectBuffer, objectMemory);
+	createBuffer(drawInfoSize, vk::BufferUsageFlagBits::eStorageBuffer, inputMemoryUsage, drawInfoBuffer, drawInfoMemory);
+	write(objectBuffer.get(), objectMemory, objects.data(), sizeof(uint32_t) * objects.size());
+	write(drawInfoBuffer.get(), drawInfoMemory, drawInfos.data(), sizeof(DrawInfo) * drawInfos.size());
+
+	createBuffer(sizeof(uint32_t) * std::max(batchCount, 1u), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+		outputMemoryUsage, counterBuffer, counterMemory);
+	createBuffer(sizeof(InstanceData) * std::max(objectCount, 1u), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+		outputMemoryUsage, visibleInstanceBuffer, visibleInstanceMemory);
+	createBuffer(sizeof(vk::DrawIndexedIndirectCommand) * std::max(drawCount, 1u), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+		outputMemoryUsage, culledCommandBuffer, culledCommandMemory);
+	// オブジェクトごとの値、ブロックごとの和、全体の和
+	uint32_t blockCount = (objectCount + localSize - 1) / localSize;
+	createBuffer(sizeof(uint32_t) * (uint64_t(objectCount) + blockCount + 1), vk::BufferUsageFlagBits::eStorageBuffer,
+		outputMemoryUsage, scanBuffer, scanMemory);
+
+	createDescriptorSet(layoutCache, descriptorAllocator, instanceBuffer, commandBuffer);
+	createPipeline(shader);
+}
+
+void GpuCulling::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, const MemoryUsage& memoryUsage, vk::UniqueBuffer& buffer, UniqueAllocation& memory)
+{
+	vk::BufferCreateInfo bufferCI;
+	bufferCI.size = size;
+	bufferCI.usage = usage | vk::BufferUsageFlagBits::eTransferDst;
+	bufferCI.sharingMode = vk::SharingMode::eExclusive;
+
+	buffer = device.createBufferUnique(bufferCI);
+
+	vk::MemoryRequirements memReq = device.getBufferMemoryRequirements(buffer.get());
+	optional<uint32_t> memoryTypeIndex = allocator->findMemoryType(memReq.memoryTypeBits, memoryUsage);
+	if (!memoryTypeIndex.has_value())
+	{
+		throw runtime_error("failed to find a suitable memory type for gpu culling!");
+	}
+
+	memory = UniqueAllocation(allocator, allocator->allocate(memReq, memoryTypeIndex.value(), true));
+	device.bindBufferMemory(buffer.get(), memory->memory, memory->offset);
+}
+
+void GpuCulling::write(vk::Buffer buffer, const UniqueAllocation& memory, const void* data, vk::DeviceSize size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+	uploadedBytes += size;
+
+	if (memory->mapped)
+	{
+		memcpy(memory->mapped, data, size);
+		allocator->flush(memory.get(), 0, size);
+		return;
+	}
+
+	uploadContext->copyToBuffer(buffer, 0, data, size);
+}
+
+void GpuCulling::createDescriptorSet(DescriptorLayoutCache& layoutCache, DescriptorAllocator& descriptorAllocator, vk::Buffer instanceBuffer, vk::Buffer commandBuffer)
+{
+	// cull.compのbindingと同じ並び
+	vk::Buffer buffers[bindingCount] = {
+		instanceBuffer,
+		objectBuffer.get(),
+		drawInfoBuffer.get(),
+		commandBuffer,
+		counterBuffer.get(),
+		visibleInstanceBuffer.get(),
+		culledCommandBuffer.get(),
+		scanBuffer.get(),
+	};
+
+	vk::DescriptorSetLayoutBinding dslBindings[bindingCount];
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		dslBindings[i].binding = i;
+		dslBindings[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+		dslBindings[i].descriptorCount = 1;
+		dslBindings[i].stageFlags = vk::ShaderStageFlagBits::eCompute;
+	}
+
+	descriptorSetLayout = layoutCache.get(dslBindings);
+	descriptorSet = descriptorAllocator.allocate(descriptorSetLayout);
+
+	vk::DescriptorBufferInfo bufferInfos[bindingCount];
+	vk::WriteDescriptorSet writes[bindingCount];
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		bufferInfos[i].buffer = buffers[i];
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+
+		writes[i].dstSet = descriptorSet;
+		writes[i].dstBinding = i;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+		writes[i].descriptorCount = 1;
+		writes[i].pBufferInfo = &bufferInfos[i];
+	}
+	device.updateDescriptorSets(bindingCount, writes, 0, nullptr);
+}
+
+void GpuCulling::createPipeline(vk::ShaderModule shader)
+{
+	vk::PushConstantRange pushRange;
+	pushRange.stageFlags = vk::ShaderStageFlagBits::eCompute;
+	pushRange.offset = 0;
+	pushRange.size = sizeof(PushConstants);
+
+	vk::PipelineLayoutCreateInfo layoutCI;
+	layoutCI.setLayoutCount = 1;
+	layoutCI.pSetLayouts = &descriptorSetLayout;
+	layoutCI.pushConstantRangeCount = 1;
+	layoutCI.pPushConstantRanges = &pushRange;
+	pipelineLayout = device.createPipelineLayoutUnique(layoutCI);
+
+	vk::Device dev = device;
+	vk::PipelineLayout layout = pipelineLayout.get();
+	pipeline = pipelineManager->request("culling", [=](vk::PipelineCache cache) {
+		vk::ComputePipelineCreateInfo pipelineCI;
+		pipelineCI.stage.stage = vk::ShaderStageFlagBits::eCompute;
+		pipelineCI.stage.module = shader;
+		pipelineCI.stage.pName = "main";
+		pipelineCI.layout = layout;
+		return dev.createComputePipelineUnique(cache, pipelineCI).value;
+	});
+}
+
+void GpuCulling::computeBarrier(vk::CommandBuffer commandBuffer)
+{
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, { barrier }, {}, {});
+}
+
+uint32_t GpuCulling::groupCount(uint32_t threadCount) const
+{
+	// 上限を超える分はシェーダ内のループで回す
+	return std::clamp((threadCount + localSize - 1) / localSize, 1u, maxGroupCount);
+}
+
+void GpuCulling::record(vk::CommandBuffer commandBuffer, const SceneData& sceneData)
+{
+	// 前のフレームの描画が出力バッファを読み終わり、前のフレームのカリングの書き込みが済んでから書き換える
+	vk::MemoryBarrier previousBarrier;
+	previousBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	previousBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eComputeShader,
+		vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, { previousBarrier }, {}, {});
+
+	commandBuffer.fillBuffer(counterBuffer.get(), 0, VK_WHOLE_SIZE, 0);
+
+	vk::MemoryBarrier clearBarrier;
+	clearBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	clearBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, { clearBarrier }, {}, {});
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelineManager->get(pipeline));
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout.get(), 0, { descriptorSet }, {});
+
+	PushConstants constants = { sceneData.rectCenter, sceneData.time, 0, objectCount, batchCount, objectCount };
+	auto dispatch = [&](uint32_t pass, uint32_t count, uint32_t groups) {
+		constants.pass = pass;
+		constants.count = count;
+		commandBuffer.pushConstants(pipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants), &constants);
+		commandBuffer.dispatch(groups, 1, 1);
+	};
+
+	// 0: ブロックごとに見えるかを判定して、ブロック内のプレフィックス和を取る
+	dispatch(0, objectCount, groupCount(objectCount));
+	computeBarrier(commandBuffer);
+	// 1: ブロックごとの和のプレフィックス和。数は少ないのでワークグループ1つで回す
+	dispatch(1, objectCount, 1);
+	computeBarrier(commandBuffer);
+	// 2: 見えたインスタンスを元の順番のまま描画ごとの領域に詰める
+	dispatch(2, objectCount, groupCount(objectCount));
+	computeBarrier(commandBuffer);
+	// 3: 描画ごとの見えた数をコマンドに書き、バッチのコマンド数を最後に見えたコマンドまでにする
+	dispatch(3, drawCount, groupCount(drawCount));
+
+	vk::MemoryBarrier drawBarrier;
+	drawBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	drawBarrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+		{}, { drawBarrier }, {}, {});
+}
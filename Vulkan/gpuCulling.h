@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include "deviceAllocator.h"
+#include "uploadContext.h"
+#include "drawList.h"
+#include "sceneData.h"
+#include "pipelineManager.h"
+#include "descriptorAllocator.h"
+
+using namespace std;
+
+// コンピュートシェーダでインスタンスごとの外接円を画面と比べ、見えるものだけを間接描画の引数に詰める
+// 見えるかどうかのプレフィックス和で詰める位置を決めるので、インスタンスもコマンドも元の順番のまま残る
+// コマンドは元の位置に置き、見えなかったものはinstanceCountを0にする
+// 描画はバッチごとにdrawIndexedIndirectCountで、数はcountバッファから読む
+// 出力バッファは全フレームで1つなので、前のフレームの描画が読み終わるのをバリアで待ってから書き換える
+class GpuCulling
+{
+public:
+	void init(vk::PhysicalDevice physicalDevice, vk::Device device, DeviceAllocator& allocator, UploadContext& uploadContext,
+		const MemoryUsage& inputMemoryUsage, vk::ShaderModule shader, PipelineManager& pipelineManager,
+		DescriptorLayoutCache& layoutCache, DescriptorAllocator& descriptorAllocator,
+		const vector<MeshDraw>& draws, const vector<IndirectDrawBatch>& batches, vk::Buffer instanceBuffer, vk::Buffer commandBuffer);
+
+	// パイプラインの作成が終わるまではfalse。その間はカリングせずに描く
+	bool isReady() const { return pipelineManager && pipelineManager->isReady(pipeline); }
+	// レンダーパスの外で、描画より前に記録する。isReady()のときだけ呼ぶ
+	void record(vk::CommandBuffer commandBuffer, const SceneData& sceneData);
+
+	vk::Buffer getVisibleInstanceBuffer() const { return visibleInstanceBuffer.get(); }
+	vk::Buffer getCommandBuffer() const { return culledCommandBuffer.get(); }
+	// 先頭からバッチごとのコマンド数が並ぶ
+	vk::Buffer getCountBuffer() const { return counterBuffer.get(); }
+	uint64_t getUploadedBytes() const { return uploadedBytes; }
+
+private:
+	// シェーダのDrawInfoと同じ並び
+	struct DrawInfo
+	{
+		Vec2 boundsCenter;
+		float boundsRadius;
+		uint32_t batch;
+		uint32_t outputBase; // 見えたインスタンスを詰める先頭
+		uint32_t batchFirstCommand;
+		uint32_t instanceCount;
+		uint32_t pad;
+	};
+
+	struct PushConstants
+	{
+		Vec2 rectCenter;
+		float time;
+		uint32_t pass;
+		uint32_t count;
+		uint32_t batchCount;
+		uint32_t objectCount;
+	};
+
+	void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, const MemoryUsage& memoryUsage, vk::UniqueBuffer& buffer, UniqueAllocation& memory);
+	void write(vk::Buffer buffer, const UniqueAllocation& memory, const void* data, vk::DeviceSize size);
+	void createPipeline(vk::ShaderModule shader);
+	void createDescriptorSet(DescriptorLayoutCache& layoutCache, DescriptorAllocator& descriptorAllocator, vk::Buffer instanceBuffer, vk::Buffer commandBuffer);
+	uint32_t groupCount(uint32_t threadCount) const;
+	void computeBarrier(vk::CommandBuffer commandBuffer);
+
+	vk::Device device;
+	DeviceAllocator* allocator = nullptr;
+	UploadContext* uploadContext = nullptr;
+	uint32_t maxGroupCount = 1;
+	uint32_t objectCount = 0; // 全描画のインスタンスの合計
+	uint32_t drawCount = 0;
+	uint32_t batchCount = 0;
+	uint64_t uploadedBytes = 0;
+	PipelineManager* pipelineManager = nullptr;
+
+	// バッファを先に破棄するためメモリを先に宣言する
+	UniqueAllocation objectMemory;
+	UniqueAllocation drawInfoMemory;
+	UniqueAllocation counterMemory;
+	UniqueAllocation visibleInstanceMemory;
+	UniqueAllocation culledCommandMemory;
+	UniqueAllocation scanMemory;
+	vk::UniqueBuffer objectBuffer; // (描画, インスタンス)の組
+	vk::UniqueBuffer drawInfoBuffer;
+	vk::UniqueBuffer counterBuffer; // バッチごとのコマンド数
+	vk::UniqueBuffer visibleInstanceBuffer;
+	vk::UniqueBuffer culledCommandBuffer;
+	vk::UniqueBuffer scanBuffer; // オブジェクトごととブロックごとのプレフィックス和
+
+	vk::DescriptorSetLayout descriptorSetLayout; // レイアウトのキャッシュが持つ
+	vk::DescriptorSet descriptorSet;
+	vk::UniquePipelineLayout pipelineLayout;
+	PipelineManager::Handle pipeline = PipelineManager::invalidHandle;
+};
@@ -0,0 +1,142 @@
+#include "gpuProfiler.h"
+
+GpuProfiler::Scope::Scope(GpuProfiler& profiler, vk::CommandBuffer commandBuffer, const char* name)
+	: profiler(profiler), commandBuffer(commandBuffer)
+{
+	scopeIndex = profiler.beginScope(commandBuffer, name);
+}
+
+GpuProfiler::Scope::~Scope()
+{
+	profiler.endScope(commandBuffer, scopeIndex);
+}
+
+void GpuProfiler::init(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t queueFamilyIndex, uint32_t framesInFlight, uint32_t maxScopes)
+{
+	this->device = device;
+	this->maxScopes = maxScopes;
+
+	// タイムスタンプに対応していないキューでは何もしない
+	uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+	if (validBits == 0)
+	{
+		supported = false;
+		return;
+	}
+	supported = true;
+	timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+	timestampPeriodNs = physicalDevice.getProperties().limits.timestampPeriod;
+
+	vk::QueryPoolCreateInfo queryPoolCI;
+	queryPoolCI.queryType = vk::QueryType::eTimestamp;
+	queryPoolCI.queryCount = maxScopes * 2; // スコープごとに開始と終了
+
+	frames.resize(framesInFlight);
+	for (auto& frame : frames)
+	{
+		frame.queryPool = device.createQueryPoolUnique(queryPoolCI);
+		frame.scopeNames.reserve(maxScopes);
+	}
+	timestamps.resize(size_t(maxScopes) * 2);
+}
+
+void GpuProfiler::beginFrame(vk::CommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	if (!supported)
+	{
+		return;
+	}
+
+	// 前回このフレームで書いた結果を回収してからプールをリセットする
+	collect(frameIndex);
+
+	currentFrame = frameIndex;
+	FrameQueries& frame = frames[frameIndex];
+	frame.scopeNames.clear();
+	commandBuffer.resetQueryPool(frame.queryPool.get(), 0, maxScopes * 2);
+}
+
+uint32_t GpuProfiler::beginScope(vk::CommandBuffer commandBuffer, const char* name)
+{
+	if (!supported)
+	{
+		return UINT32_MAX;
+	}
+
+	FrameQueries& frame = frames[currentFrame];
+	if (frame.scopeNames.size() >= maxScopes)
+	{
+		return UINT32_MAX;
+	}
+
+	uint32_t scopeIndex = static_cast<uint32_t>(frame.scopeNames.size());
+	frame.scopeNames.push_back(name);
+	frame.pending = true;
+	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.queryPool.get(), scopeIndex * 2);
+	return scopeIndex;
+}
+
+void GpuProfiler::endScope(vk::CommandBuffer commandBuffer, uint32_t scopeIndex)
+{
+	if (!supported || scopeIndex == UINT32_MAX)
+	{
+		return;
+	}
+
+	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, frames[currentFrame].queryPool.get(), scopeIndex * 2 + 1);
+}
+
+void GpuProfiler::collect(uint32_t frameIndex)
+{
+	FrameQueries& frame = frames[frameIndex];
+	if (!frame.pending || frame.scopeNames.empty())
+	{
+		return;
+	}
+	frame.pending = false;
+
+	// fenceを待った後なので揃っているはずだが、eWaitは付けずに揃っていなければ捨てる
+	uint32_t queryCount = static_cast<uint32_t>(frame.scopeNames.size()) * 2;
+	vk::Result result = device.getQueryPoolResults(frame.queryPool.get(), 0, queryCount,
+		queryCount * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+	if (result != vk::Result::eSuccess)
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < frame.scopeNames.size(); i++)
+	{
+		uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & timestampMask;
+		double ms = double(ticks) * timestampPeriodNs / 1'000'000.0;
+
+		ScopeStats& scope = stats[frame.scopeNames[i]];
+		if (scope.sampleCount == 0)
+		{
+			scope.name = frame.scopeNames[i];
+			scope.averageMs = ms;
+		}
+		else
+		{
+			scope.averageMs += (ms - scope.averageMs) * 0.05;
+		}
+		scope.lastMs = ms;
+		scope.sampleCount++;
+	}
+}
+
+double GpuProfiler::getScopeMs(const string& name) const
+{
+	auto it = stats.find(name);
+	return it != stats.end() ? it->second.averageMs : 0.0;
+}
+
+vector<GpuProfiler::ScopeStats> GpuProfiler::getStats() const
+{
+	vector<ScopeStats> result;
+	result.reserve(stats.size());
+	for (const auto& [name, scope] : stats)
+	{
+		result.push_back(scope);
+	}
+	return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+// タイムスタンプクエリでGPU上の処理時間を計測する
+// クエリプールはフレームごとに持ち、結果はそのフレームのfenceを待った後に読むのでストールしない
+class GpuProfiler
+{
+public:
+	// 生成と破棄でスコープの開始と終了のタイムスタンプを書き込む
+	class Scope
+	{
+	public:
+		Scope(GpuProfiler& profiler, vk::CommandBuffer commandBuffer, const char* name);
+		~Scope();
+	private:
+		GpuProfiler& profiler;
+		vk::CommandBuffer commandBuffer;
+		uint32_t scopeIndex;
+	};
+
+	struct ScopeStats
+	{
+		string name;
+		double lastMs = 0.0;
+		double averageMs = 0.0; // 指数移動平均
+		uint64_t sampleCount = 0;
+	};
+
+	void init(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t queueFamilyIndex, uint32_t framesInFlight, uint32_t maxScopes = 64);
+	void beginFrame(vk::CommandBuffer commandBuffer, uint32_t frameIndex);
+	// nameは文字列リテラルなど結果を回収するまで有効なものを渡す
+	uint32_t beginScope(vk::CommandBuffer commandBuffer, const char* name);
+	void endScope(vk::CommandBuffer commandBuffer, uint32_t scopeIndex);
+
+	bool isSupported() const { return supported; }
+	double getScopeMs(const string& name) const;
+	vector<ScopeStats> getStats() const;
+
+private:
+	void collect(uint32_t frameIndex);
+
+	struct FrameQueries
+	{
+		vk::UniqueQueryPool queryPool;
+		vector<const char*> scopeNames;
+		bool pending = false; // 結果がまだ読まれていない
+	};
+
+	bool supported = false;
+	vk::Device device;
+	double timestampPeriodNs = 1.0;
+	uint64_t timestampMask = ~0ull;
+	uint32_t maxScopes = 0;
+	uint32_t currentFrame = 0;
+	vector<FrameQueries> frames;
+	vector<uint64_t> timestamps;
+	unordered_map<string, ScopeStats> stats;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint64_t fnv1aOffsetBasis = 0xcbf29ce484222325ull;
+constexpr uint64_t fnv1aPrime = 0x100000001b3ull;
+
+// 64ビットのFNV-1a。hashに前回の値を渡せば続けて計算できる
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = fnv1aOffsetBasis)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= fnv1aPrime;
+	}
+	return hash;
+}
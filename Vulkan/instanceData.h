@@ -0,0 +1,28 @@
+#pragma once
+
+#include "vertexLayout.h"
+
+// インスタンスごとの変換と色。頂点とは別のbinding 1からインスタンス単位で読む
+struct InstanceData
+{
+	Vec2 offset;
+	float scale; // メッシュの頂点に掛ける
+	float phase; // アニメーションの位相
+	Vec3 color; // 頂点色に掛ける
+	float radius; // offsetの周りを回る半径。0なら動かない
+};
+
+template<> struct VertexTraits<InstanceData>
+{
+	static constexpr vk::VertexInputRate inputRate = vk::VertexInputRate::eInstance;
+	static constexpr array<VertexAttribute, 5> attributes = {
+		VERTEX_ATTRIBUTE(InstanceData, offset, 2),
+		VERTEX_ATTRIBUTE(InstanceData, scale, 3),
+		VERTEX_ATTRIBUTE(InstanceData, phase, 4),
+		VERTEX_ATTRIBUTE(InstanceData, color, 5),
+		VERTEX_ATTRIBUTE(InstanceData, radius, 6),
+	};
+};
+
+// 普通のメッシュを描くときに使う、何も変えないインスタンス
+constexpr InstanceData identityInstance = { Vec2{ 0.0f, 0.0f }, 1.0f, 0.0f, Vec3{ 1.0f, 1.0f, 1.0f }, 0.0f };
@@ -2,10 +2,90 @@
 #include "vulkan.h"
 #pragma comment(lib, "vulkan-1.lib")
 
-int main()
+int main(int argc, char** argv)
 {
-	Vulkan engine;
+	EngineConfig config;
+	const char* packFile = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		string_view arg = argv[i];
+		if (arg == "--headless")
+		{
+			config.headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+		{
+			config.frameCount = static_cast<uint32_t>(stoul(argv[++i]));
+		}
+		else if (arg == "--frames-in-flight" && i + 1 < argc)
+		{
+			config.framesInFlight = static_cast<uint32_t>(stoul(argv[++i]));
+		}
+		else if (arg == "--readback" && i + 1 < argc)
+		{
+			config.readback = true;
+			config.readbackFile = argv[++i];
+		}
+		else if (arg == "--no-mesh-optimize")
+		{
+			config.optimizeMeshes = false;
+		}
+		else if (arg == "--vertex-format" && i + 1 < argc)
+		{
+			if (!parseVertexFormat(argv[++i], config.vertexFormat))
+			{
+				std::cerr << "unknown vertex format: " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--no-indirect")
+		{
+			config.indirectDraws = false;
+		}
+		else if (arg == "--no-gpu-culling")
+		{
+			config.gpuCulling = false;
+		}
+		else if (arg == "--no-push-constants")
+		{
+			config.pushConstants = false;
+		}
+		else if (arg == "--no-async-transfer")
+		{
+			config.asyncTransfer = false;
+		}
+		else if (arg == "--pipeline-cache" && i + 1 < argc)
+		{
+			config.pipelineCacheFile = argv[++i];
+		}
+		else if (arg == "--no-pipeline-cache")
+		{
+			config.pipelineCacheFile = nullptr;
+		}
+		else if (arg == "--pack" && i + 1 < argc)
+		{
+			packFile = argv[++i];
+		}
+		else if (arg == "--profile" && i + 1 < argc)
+		{
+			config.profileFile = argv[++i];
+		}
+	}
+
+	// 読み戻しはオフスクリーンのイメージからしかできない
+	if (config.readback && !config.headless)
+	{
+		std::cerr << "--readback requires --headless" << std::endl;
+		return 1;
+	}
+
+	Vulkan engine(config);
+	if (packFile)
+	{
+		engine.addAssetPack(packFile);
+	}
 	engine.run();
 
-	return 0;
-}
\ No newline at end of file
+	// 読み戻しで最後の2フレームが一致しなければ失敗として終わる
+	return engine.getFrameStats().readbackMismatch ? 1 : 0;
+}
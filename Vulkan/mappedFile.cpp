@@ -0,0 +1,139 @@
+#include "mappedFile.h"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(mapped, other.mapped);
+		std::swap(fileSize, other.fileSize);
+#ifdef _WIN32
+		std::swap(fileHandle, other.fileHandle);
+		std::swap(mappingHandle, other.mappingHandle);
+#endif
+	}
+	return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* fileName)
+{
+	close();
+
+	// 先頭から順に読むことが多いので先読みを促す
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+	mapped = static_cast<const uint8_t*>(view);
+	fileSize = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mapped)
+	{
+		UnmapViewOfFile(mapped);
+	}
+	if (mappingHandle)
+	{
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle)
+	{
+		CloseHandle(fileHandle);
+	}
+	mapped = nullptr;
+	fileSize = 0;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const char* fileName)
+{
+	close();
+
+	int fd = ::open(fileName, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // マップはファイルを閉じても残る
+	if (view == MAP_FAILED)
+	{
+		return false;
+	}
+	madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+	mapped = static_cast<const uint8_t*>(view);
+	fileSize = static_cast<size_t>(st.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mapped)
+	{
+		munmap(const_cast<uint8_t*>(mapped), fileSize);
+	}
+	mapped = nullptr;
+	fileSize = 0;
+}
+
+#endif
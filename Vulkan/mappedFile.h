@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ファイル全体を読み取り専用でメモリにマップする。ページはアクセスしたときにOSが読み込む
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile() { close(); }
+
+	// 開けなければfalse
+	bool open(const char* fileName);
+	void close();
+
+	const uint8_t* data() const { return mapped; }
+	size_t size() const { return fileSize; }
+	bool isOpen() const { return mapped != nullptr; }
+
+private:
+	const uint8_t* mapped = nullptr;
+	size_t fileSize = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "vertex.h"
+#include <vector>
+#include <cstdint>
+
+struct Mesh
+{
+	vector<Vertex> vert;
+	vector<uint32_t> indices;
+};
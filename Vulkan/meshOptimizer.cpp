@@ -0,0 +1,311 @@
+#include "meshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+vector<uint32_t> optimizeVertexCache(const vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize, vector<uint32_t>* clusters)
+{
+	size_t triangleCount = indices.size() / 3;
+	vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+	if (clusters)
+	{
+		clusters->clear();
+	}
+	if (triangleCount == 0)
+	{
+		return result;
+	}
+
+	// 頂点ごとに、それを使う三角形の一覧を作る
+	vector<uint32_t> liveCount(vertexCount, 0);
+	for (uint32_t index : indices)
+	{
+		liveCount[index]++;
+	}
+
+	vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + liveCount[v];
+	}
+
+	vector<uint32_t> adjacency(indices.size());
+	vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (size_t k = 0; k < 3; k++)
+		{
+			adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	vector<uint32_t> cacheTime(vertexCount, 0);
+	vector<bool> emitted(triangleCount, false);
+	vector<uint32_t> deadEnd; // 最近使った頂点。行き止まりになったらここから再開する
+	vector<uint32_t> candidates;
+
+	uint32_t timeStamp = cacheSize + 1;
+	size_t cursor = 0;
+	int64_t fanningVertex = 0;
+	bool startCluster = true;
+
+	while (fanningVertex >= 0)
+	{
+		uint32_t f = static_cast<uint32_t>(fanningVertex);
+		candidates.clear();
+
+		// 扇の中心の頂点を使う三角形をすべて出力する
+		for (uint32_t a = adjacencyOffset[f]; a < adjacencyOffset[f + 1]; a++)
+		{
+			uint32_t t = adjacency[a];
+			if (emitted[t])
+			{
+				continue;
+			}
+
+			if (startCluster && clusters)
+			{
+				clusters->push_back(static_cast<uint32_t>(result.size() / 3));
+			}
+			startCluster = false;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint32_t v = indices[t * 3 + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveCount[v]--;
+				if (timeStamp - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = timeStamp++;
+				}
+			}
+			emitted[t] = true;
+		}
+
+		// 次の扇の中心は、キャッシュに残っていて、扇を作ってもキャッシュから追い出されないものを選ぶ
+		int64_t best = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t v : candidates)
+		{
+			if (liveCount[v] == 0)
+			{
+				continue;
+			}
+
+			int64_t priority = 0;
+			if (timeStamp - cacheTime[v] + 2 * liveCount[v] <= cacheSize)
+			{
+				priority = timeStamp - cacheTime[v];
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+
+		if (best >= 0)
+		{
+			fanningVertex = best;
+			continue;
+		}
+
+		// 行き止まり。ここでキャッシュの局所性が途切れるのでクラスタを区切る
+		startCluster = true;
+		fanningVertex = -1;
+		while (!deadEnd.empty())
+		{
+			uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveCount[v] > 0)
+			{
+				fanningVertex = v;
+				break;
+			}
+		}
+
+		while (fanningVertex < 0 && cursor < vertexCount)
+		{
+			if (liveCount[cursor] > 0)
+			{
+				fanningVertex = static_cast<int64_t>(cursor);
+			}
+			cursor++;
+		}
+	}
+
+	return result;
+}
+
+vector<uint32_t> optimizeOverdraw(const vector<uint32_t>& indices, const vector<uint32_t>& clusters,
+	const float* positions, size_t stride, uint32_t componentCount, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (clusters.size() <= 1)
+	{
+		return indices;
+	}
+
+	auto position = [&](uint32_t v) {
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + stride * v);
+		return Vec3{ p[0], p[1], componentCount >= 3 ? p[2] : 0.0f };
+	};
+
+	// メッシュ全体の重心
+	Vec3 meshCentroid = { 0.0f, 0.0f, 0.0f };
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		Vec3 p = position(static_cast<uint32_t>(v));
+		meshCentroid.x += p.x;
+		meshCentroid.y += p.y;
+		meshCentroid.z += p.z;
+	}
+	if (vertexCount > 0)
+	{
+		meshCentroid.x /= vertexCount;
+		meshCentroid.y /= vertexCount;
+		meshCentroid.z /= vertexCount;
+	}
+
+	// クラスタの重心と面積で重み付けした法線から、外側を向いている度合いを求める
+	vector<float> sortKey(clusters.size());
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		size_t begin = clusters[c];
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+		Vec3 centroid = { 0.0f, 0.0f, 0.0f };
+		Vec3 normal = { 0.0f, 0.0f, 0.0f };
+		float area = 0.0f;
+		for (size_t t = begin; t < end; t++)
+		{
+			Vec3 p0 = position(indices[t * 3 + 0]);
+			Vec3 p1 = position(indices[t * 3 + 1]);
+			Vec3 p2 = position(indices[t * 3 + 2]);
+
+			Vec3 e1 = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+			Vec3 e2 = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+			Vec3 n = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+			float triangleArea = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+
+			centroid.x += (p0.x + p1.x + p2.x) / 3.0f * triangleArea;
+			centroid.y += (p0.y + p1.y + p2.y) / 3.0f * triangleArea;
+			centroid.z += (p0.z + p1.z + p2.z) / 3.0f * triangleArea;
+			normal.x += n.x;
+			normal.y += n.y;
+			normal.z += n.z;
+			area += triangleArea;
+		}
+
+		if (area > 0.0f)
+		{
+			centroid.x /= area;
+			centroid.y /= area;
+			centroid.z /= area;
+		}
+
+		float normalLength = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+		if (normalLength > 0.0f)
+		{
+			normal.x /= normalLength;
+			normal.y /= normalLength;
+			normal.z /= normalLength;
+		}
+
+		sortKey[c] = (centroid.x - meshCentroid.x) * normal.x + (centroid.y - meshCentroid.y) * normal.y + (centroid.z - meshCentroid.z) * normal.z;
+	}
+
+	// 外側を向いているクラスタほど手前にあることが多いので先に描く。同じ値なら元の順番を保つ
+	vector<uint32_t> order(clusters.size());
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+	vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (uint32_t c : order)
+	{
+		size_t begin = clusters[c];
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		result.insert(result.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+	}
+	return result;
+}
+
+vector<uint32_t> optimizeVertexFetchRemap(vector<uint32_t>& indices, size_t vertexCount, uint32_t& usedVertexCount)
+{
+	vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	usedVertexCount = 0;
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = usedVertexCount++;
+		}
+		index = remap[index];
+	}
+	return remap;
+}
+
+OptimizedMesh optimizeMesh(const Mesh& mesh, bool reorder)
+{
+	OptimizedMesh result;
+	vector<uint32_t> indices = mesh.indices;
+	result.vertices = mesh.vert;
+
+	if (reorder && !indices.empty() && !mesh.vert.empty())
+	{
+		vector<uint32_t> clusters;
+		indices = optimizeVertexCache(indices, mesh.vert.size(), defaultVertexCacheSize, &clusters);
+		indices = optimizeOverdraw(indices, clusters, &mesh.vert[0].pos.x, sizeof(Vertex), 2, mesh.vert.size());
+
+		uint32_t usedVertexCount = 0;
+		vector<uint32_t> remap = optimizeVertexFetchRemap(indices, mesh.vert.size(), usedVertexCount);
+		result.vertices = remapVertices(mesh.vert, remap, usedVertexCount);
+	}
+
+	if (result.vertices.size() < 65536)
+	{
+		result.indexType = vk::IndexType::eUint16;
+		result.indices16.reserve(indices.size());
+		for (uint32_t index : indices)
+		{
+			result.indices16.push_back(static_cast<uint16_t>(index));
+		}
+	}
+	else
+	{
+		result.indices32 = std::move(indices);
+	}
+	return result;
+}
+
+void computeBounds(const vector<Vertex>& vertices, Vec2& center, float& radius)
+{
+	center = Vec2{ 0.0f, 0.0f };
+	radius = 0.0f;
+	if (vertices.empty())
+	{
+		return;
+	}
+
+	Vec2 minPos = vertices[0].pos;
+	Vec2 maxPos = vertices[0].pos;
+	for (const Vertex& v : vertices)
+	{
+		minPos = Vec2{ std::min(minPos.x, v.pos.x), std::min(minPos.y, v.pos.y) };
+		maxPos = Vec2{ std::max(maxPos.x, v.pos.x), std::max(maxPos.y, v.pos.y) };
+	}
+	center = Vec2{ (minPos.x + maxPos.x) * 0.5f, (minPos.y + maxPos.y) * 0.5f };
+
+	float radiusSq = 0.0f;
+	for (const Vertex& v : vertices)
+	{
+		float dx = v.pos.x - center.x;
+		float dy = v.pos.y - center.y;
+		radiusSq = std::max(radiusSq, dx * dx + dy * dy);
+	}
+	radius = sqrtf(radiusSq);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <cstdint>
+#include "mesh.h"
+
+using namespace std;
+
+// 頂点キャッシュの大きさの目安。実際のGPUのキャッシュは厳密なFIFOではないので経験的な値を使う
+constexpr uint32_t defaultVertexCacheSize = 16;
+
+// Tipsify（Sander et al. 2007）で変換後の頂点キャッシュに当たりやすい三角形の順番にする
+// clustersには各クラスタの先頭の三角形番号が入る。クラスタの境目はキャッシュが途切れる所
+vector<uint32_t> optimizeVertexCache(const vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize, vector<uint32_t>* clusters);
+
+// クラスタを外側を向いているものから描くように並べ替える（視点に依存しないオーバードローの削減）
+// positionsはcomponentCount(2か3)個のfloatがstrideバイトおきに並んだもの。2次元ならz=0として扱う
+vector<uint32_t> optimizeOverdraw(const vector<uint32_t>& indices, const vector<uint32_t>& clusters,
+	const float* positions, size_t stride, uint32_t componentCount, size_t vertexCount);
+
+// 頂点を最初に参照される順番に並べ替える対応表を作り、indicesを書き換える
+// 戻り値は古い番号から新しい番号への対応（使われない頂点はUINT32_MAX）
+vector<uint32_t> optimizeVertexFetchRemap(vector<uint32_t>& indices, size_t vertexCount, uint32_t& usedVertexCount);
+
+template<class V>
+vector<V> remapVertices(const vector<V>& vertices, const vector<uint32_t>& remap, uint32_t usedVertexCount)
+{
+	vector<V> result(usedVertexCount);
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		if (remap[i] != UINT32_MAX)
+		{
+			result[remap[i]] = vertices[i];
+		}
+	}
+	return result;
+}
+
+// アップロードする形にしたメッシュ。頂点が65536個未満ならインデックスは16ビットになる
+struct OptimizedMesh
+{
+	vector<Vertex> vertices;
+	vk::IndexType indexType = vk::IndexType::eUint32;
+	vector<uint16_t> indices16;
+	vector<uint32_t> indices32;
+
+	const void* indexData() const { return indexType == vk::IndexType::eUint16 ? static_cast<const void*>(indices16.data()) : indices32.data(); }
+	uint32_t indexCount() const { return static_cast<uint32_t>(indexType == vk::IndexType::eUint16 ? indices16.size() : indices32.size()); }
+	size_t indexSize() const { return indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t); }
+};
+
+// reorderがtrueなら三角形と頂点の並べ替えも行う。インデックスの縮小は常に行う
+OptimizedMesh optimizeMesh(const Mesh& mesh, bool reorder);
+
+// 頂点を囲む円（AABBの中心と、そこから一番遠い頂点までの距離）
+void computeBounds(const vector<Vertex>& vertices, Vec2& center, float& radius);
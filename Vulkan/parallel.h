@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// [0, count)をgrain個ずつに区切り、ハードウェアスレッドの数までのスレッドで func(begin, end) を呼ぶ
+// 呼び出したスレッドも処理に加わり、すべて終わってから戻る
+template<class Func>
+void parallelFor(size_t count, size_t grain, Func&& func)
+{
+	grain = std::max<size_t>(grain, 1);
+	size_t chunkCount = (count + grain - 1) / grain;
+	size_t threadCount = std::min<size_t>(std::max(thread::hardware_concurrency(), 1u), chunkCount);
+	if (threadCount <= 1)
+	{
+		func(size_t(0), count);
+		return;
+	}
+
+	atomic<size_t> nextChunk = 0;
+	auto worker = [&]() {
+		for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+		{
+			func(chunk * grain, std::min(count, (chunk + 1) * grain));
+		}
+	};
+
+	vector<thread> threads;
+	for (size_t i = 1; i < threadCount; i++)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+}
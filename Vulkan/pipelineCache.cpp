@@ -0,0 +1,114 @@
+#include "pipelineCache.h"
+#include "hash.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+
+void PipelineCache::init(vk::PhysicalDevice physicalDevice, vk::Device device, const char* fileName)
+{
+	this->device = device;
+	this->fileName = fileName ? fileName : "";
+	props = physicalDevice.getProperties();
+	loaded = false;
+
+	vector<uint8_t> data;
+	if (fileName)
+	{
+		ifstream ifs(fileName, ios::binary);
+		FileHeader header;
+		if (ifs.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		{
+			// 大きさはヘッダーを確かめてから信用する
+			if (header.magic == fileMagic && header.dataSize <= filesystem::file_size(fileName) - sizeof(header))
+			{
+				data.resize(size_t(header.dataSize));
+				ifs.read(reinterpret_cast<char*>(data.data()), data.size());
+			}
+			if (!ifs || !validate(header, data))
+			{
+				std::cerr << "パイプラインキャッシュ " << fileName << " はこのデバイス用ではないので使いません。" << std::endl;
+				data.clear();
+			}
+		}
+	}
+
+	vk::PipelineCacheCreateInfo cacheCI;
+	cacheCI.initialDataSize = data.size();
+	cacheCI.pInitialData = data.empty() ? nullptr : data.data();
+	cache = device.createPipelineCacheUnique(cacheCI);
+	loaded = !data.empty();
+}
+
+PipelineCache::FileHeader PipelineCache::makeHeader() const
+{
+	FileHeader header = {};
+	header.magic = fileMagic;
+	header.headerVersion = fileVersion;
+	header.vendorID = props.vendorID;
+	header.deviceID = props.deviceID;
+	header.driverVersion = props.driverVersion;
+	memcpy(header.pipelineCacheUUID, props.pipelineCacheUUID.data(), VK_UUID_SIZE);
+	return header;
+}
+
+bool PipelineCache::validate(const FileHeader& header, const vector<uint8_t>& data) const
+{
+	FileHeader expected = makeHeader();
+	if (header.magic != expected.magic || header.headerVersion != expected.headerVersion ||
+		header.vendorID != expected.vendorID || header.deviceID != expected.deviceID ||
+		header.driverVersion != expected.driverVersion ||
+		memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		return false;
+	}
+	if (data.size() != header.dataSize || fnv1a(data.data(), data.size()) != header.dataHash)
+	{
+		return false;
+	}
+
+	// ドライバー自身のヘッダー（VkPipelineCacheHeaderVersionOne）も同じデバイスを指しているか確かめる
+	if (data.size() < 16 + VK_UUID_SIZE)
+	{
+		return false;
+	}
+	uint32_t driverHeader[4];
+	memcpy(driverHeader, data.data(), sizeof(driverHeader));
+	return driverHeader[1] == uint32_t(vk::PipelineCacheHeaderVersion::eOne) &&
+		driverHeader[2] == props.vendorID && driverHeader[3] == props.deviceID &&
+		memcmp(data.data() + 16, props.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save()
+{
+	if (fileName.empty() || !cache)
+	{
+		return;
+	}
+
+	vector<uint8_t> data = device.getPipelineCacheData(cache.get());
+	FileHeader header = makeHeader();
+	header.dataSize = data.size();
+	header.dataHash = fnv1a(data.data(), data.size());
+
+	string tempName = fileName + ".tmp";
+	{
+		ofstream ofs(tempName, ios::binary | ios::trunc);
+		ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+		if (!ofs.flush())
+		{
+			std::cerr << "パイプラインキャッシュを書き込めませんでした: " << tempName << std::endl;
+			return;
+		}
+	}
+
+	// 同じボリューム内のrenameで置き換えるので、読む側は古いか新しいかどちらかの完全なファイルを見る
+	error_code ec;
+	filesystem::rename(tempName, fileName, ec);
+	if (ec)
+	{
+		std::cerr << "パイプラインキャッシュを保存できませんでした: " << ec.message() << std::endl;
+		filesystem::remove(tempName, ec);
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// VkPipelineCacheをファイルから読み込み、終了時に書き戻す
+// ファイルの先頭に自前のヘッダーを付け、pipelineCacheUUID・ベンダー/デバイスID・ドライバーのバージョンが
+// 今のデバイスと一致し、データが壊れていないときだけ初期データとして使う。一致しなければ空のキャッシュから始める
+class PipelineCache
+{
+public:
+	// fileNameがnullptrならファイルを使わないキャッシュになる
+	void init(vk::PhysicalDevice physicalDevice, vk::Device device, const char* fileName);
+	// 一時ファイルに書いてから置き換えるので、途中で落ちても前のファイルが壊れない
+	void save();
+
+	vk::PipelineCache get() const { return cache.get(); }
+	bool isWarm() const { return loaded; } // 有効なファイルを読み込めたか
+
+private:
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t headerVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t dataHash; // データのFNV-1a
+	};
+
+	static constexpr uint32_t fileMagic = 0x43505650; // "PVPC"
+	static constexpr uint32_t fileVersion = 1;
+
+	FileHeader makeHeader() const;
+	bool validate(const FileHeader& header, const vector<uint8_t>& data) const;
+
+	vk::Device device;
+	vk::PhysicalDeviceProperties props;
+	string fileName;
+	bool loaded = false;
+	vk::UniquePipelineCache cache;
+};
@@ -0,0 +1,147 @@
+#include "pipelineManager.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+PipelineManager::~PipelineManager()
+{
+	shutdown();
+}
+
+void PipelineManager::init(vk::PipelineCache pipelineCache, uint32_t threadCount)
+{
+	this->pipelineCache = pipelineCache;
+	if (threadCount == 0)
+	{
+		threadCount = std::clamp(thread::hardware_concurrency() / 2, 1u, 4u);
+	}
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		workers.emplace_back(&PipelineManager::workerLoop, this);
+	}
+}
+
+void PipelineManager::shutdown()
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+		stopping = true;
+		queue.clear(); // まだ始まっていないものは作らない
+	}
+	queueCondition.notify_all();
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+}
+
+PipelineManager::Handle PipelineManager::request(const char* name, BuildFunc build, Handle fallback)
+{
+	Handle handle = static_cast<Handle>(entries.size());
+	Entry& entry = entries.emplace_back();
+	entry.name = name;
+	entry.build = std::move(build);
+	entry.fallback = fallback;
+
+	{
+		lock_guard<mutex> lock(queueMutex);
+		queue.push_back(&entry);
+	}
+	queueCondition.notify_one();
+	return handle;
+}
+
+void PipelineManager::workerLoop()
+{
+	for (;;)
+	{
+		Entry* entry = nullptr;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			queueCondition.wait(lock, [&] { return stopping || !queue.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+			entry = queue.front();
+			queue.pop_front();
+			runningCount++;
+		}
+
+		State state = State::Ready;
+		auto start = chrono::steady_clock::now();
+		try
+		{
+			entry->pipeline = entry->build(pipelineCache);
+		}
+		catch (const exception& e)
+		{
+			std::cerr << "パイプライン " << entry->name << " の作成に失敗しました: " << e.what() << std::endl;
+			state = State::Failed;
+		}
+		entry->compileMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		entry->build = nullptr; // キャプチャしたものを手放す
+		entry->state.store(state, memory_order_release);
+
+		{
+			lock_guard<mutex> lock(queueMutex);
+			runningCount--;
+		}
+		doneCondition.notify_all();
+	}
+}
+
+bool PipelineManager::isReady(Handle handle) const
+{
+	return handle < entries.size() && entries[handle].state.load(memory_order_acquire) == State::Ready;
+}
+
+vk::Pipeline PipelineManager::get(Handle handle) const
+{
+	while (handle < entries.size())
+	{
+		const Entry& entry = entries[handle];
+		if (entry.state.load(memory_order_acquire) == State::Ready)
+		{
+			return entry.pipeline.get();
+		}
+		handle = entry.fallback;
+	}
+	return nullptr;
+}
+
+void PipelineManager::wait(Handle handle)
+{
+	if (handle >= entries.size())
+	{
+		return;
+	}
+	const Entry& entry = entries[handle];
+	unique_lock<mutex> lock(queueMutex);
+	doneCondition.wait(lock, [&] { return entry.state.load(memory_order_acquire) != State::Pending; });
+}
+
+void PipelineManager::waitIdle()
+{
+	unique_lock<mutex> lock(queueMutex);
+	doneCondition.wait(lock, [&] { return queue.empty() && runningCount == 0; });
+}
+
+double PipelineManager::getCompileMs(Handle handle) const
+{
+	return isReady(handle) ? entries[handle].compileMs : 0.0;
+}
+
+double PipelineManager::getTotalCompileMs() const
+{
+	double total = 0.0;
+	for (const Entry& entry : entries)
+	{
+		if (entry.state.load(memory_order_acquire) == State::Ready)
+		{
+			total += entry.compileMs;
+		}
+	}
+	return total;
+}
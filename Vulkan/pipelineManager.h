@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// パイプラインの作成をワーカースレッドで行う
+// request()はすぐにハンドルを返し、作成が終わるまでget()はフォールバックのパイプラインかnullptrを返すので、
+// フレームループがドライバーのコンパイルを待つことはない
+// VkPipelineCacheは内部で同期されるので、全ワーカーで同じキャッシュを共有する
+// request()とget()はフレームループのスレッドから呼ぶこと
+class PipelineManager
+{
+public:
+	using Handle = uint32_t;
+	static constexpr Handle invalidHandle = UINT32_MAX;
+
+	// ワーカースレッドで呼ばれる。参照するハンドルや記述は値でキャプチャしておく
+	using BuildFunc = function<vk::UniquePipeline(vk::PipelineCache)>;
+
+	~PipelineManager();
+
+	// threadCountが0ならハードウェアスレッドの半分（1～4）
+	void init(vk::PipelineCache pipelineCache, uint32_t threadCount = 0);
+
+	// fallbackは準備できるまでの代わりに使うパイプライン
+	Handle request(const char* name, BuildFunc build, Handle fallback = invalidHandle);
+
+	bool isReady(Handle handle) const;
+	// 準備できていなければフォールバックを辿る。どれも使えなければnullptrを返すので、その描画は飛ばす
+	vk::Pipeline get(Handle handle) const;
+	// 起動時など待ってよい所でだけ使う
+	void wait(Handle handle);
+	void waitIdle();
+
+	double getCompileMs(Handle handle) const;
+	double getTotalCompileMs() const; // 作成が終わったパイプラインの合計
+
+private:
+	enum class State : uint32_t
+	{
+		Pending,
+		Ready,
+		Failed,
+	};
+
+	struct Entry
+	{
+		string name;
+		BuildFunc build;
+		Handle fallback = invalidHandle;
+		vk::UniquePipeline pipeline;
+		double compileMs = 0.0;
+		atomic<State> state = State::Pending;
+	};
+
+	void workerLoop();
+	void shutdown();
+
+	vk::PipelineCache pipelineCache;
+	deque<Entry> entries; // 伸ばしても要素は移動しない
+	vector<thread> workers;
+
+	mutable mutex queueMutex;
+	condition_variable queueCondition; // ジョブが増えたか終了
+	condition_variable doneCondition; // ジョブが終わった
+	deque<Entry*> queue;
+	uint32_t runningCount = 0;
+	bool stopping = false;
+};
@@ -4,4 +4,5 @@
 struct SceneData
 {
 	Vec2 rectCenter;
+	float time; // インスタンスのアニメーションに使う
 };
@@ -0,0 +1,56 @@
+#include "shaderLibrary.h"
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+	// 各.incはVulkan.vcxprojのカスタムビルドで "glslc -mfmt=num" が出力する
+	alignas(4) constexpr uint32_t shaderVert[] = {
+#include "shaders/shader.vert.spv.inc"
+	};
+	alignas(4) constexpr uint32_t shaderVertPush[] = {
+#include "shaders/shader.vert.push.spv.inc"
+	};
+	alignas(4) constexpr uint32_t shaderFrag[] = {
+#include "shaders/shader.frag.spv.inc"
+	};
+	alignas(4) constexpr uint32_t cullComp[] = {
+#include "shaders/cull.comp.spv.inc"
+	};
+
+	constexpr ShaderCode shaders[] = {
+		{ "shader.vert", shaderVert, sizeof(shaderVert) },
+		{ "shader.vert.push", shaderVertPush, sizeof(shaderVertPush) },
+		{ "shader.frag", shaderFrag, sizeof(shaderFrag) },
+		{ "cull.comp", cullComp, sizeof(cullComp) },
+	};
+
+	// SPIR-Vのマジックナンバー
+	static_assert(shaderVert[0] == 0x07230203 && shaderVertPush[0] == 0x07230203 && shaderFrag[0] == 0x07230203 && cullComp[0] == 0x07230203, "invalid SPIR-V");
+}
+
+const ShaderCode* findShader(string_view name)
+{
+	for (const ShaderCode& shader : shaders)
+	{
+		if (shader.name == name)
+		{
+			return &shader;
+		}
+	}
+	return nullptr;
+}
+
+vk::UniqueShaderModule createShaderModule(vk::Device device, string_view name)
+{
+	const ShaderCode* shader = findShader(name);
+	if (!shader)
+	{
+		throw runtime_error("unknown shader: " + string(name));
+	}
+
+	vk::ShaderModuleCreateInfo shaderCI;
+	shaderCI.codeSize = shader->size;
+	shaderCI.pCode = shader->code;
+	return device.createShaderModuleUnique(shaderCI);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+using namespace std;
+
+// ビルド時にglslcで数値の並びにしたSPIR-Vを実行ファイルに組み込んでおき、名前で引く
+// 実行時にファイルを読まないので作業ディレクトリに依存しない
+struct ShaderCode
+{
+	string_view name; // ソースのファイル名（"shader.vert"など）
+	const uint32_t* code;
+	size_t size; // バイト数
+};
+
+// 見つからなければnullptr
+const ShaderCode* findShader(string_view name);
+vk::UniqueShaderModule createShaderModule(vk::Device device, string_view name);
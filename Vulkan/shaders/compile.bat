@@ -1,3 +1,5 @@
-C:/VulkanSDK/1.3.268.0/Bin/glslc.exe shader.vert -o shader.vert.spv
-C:/VulkanSDK/1.3.268.0/Bin/glslc.exe shader.frag -o shader.frag.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe -mfmt=num shader.vert -o shader.vert.spv.inc
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe -mfmt=num -DPUSH_CONSTANTS shader.vert -o shader.vert.push.spv.inc
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe -mfmt=num shader.frag -o shader.frag.spv.inc
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe -mfmt=num cull.comp -o cull.comp.spv.inc
 pause
\ No newline at end of file
@@ -1,16 +1,29 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// -DPUSH_CONSTANTSでコンパイルしたものはプッシュ定数から読む（shader.vert.push）
+#ifdef PUSH_CONSTANTS
+layout(push_constant) uniform SceneData
+#else
 layout(set = 0, binding = 0) uniform SceneData
+#endif
 {
 	vec2 rectCenter;
+	float time;
 }sceneData;
 
 layout(location = 0) in vec2 inPos;
 layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 instOffset;
+layout(location = 3) in float instScale;
+layout(location = 4) in float instPhase;
+layout(location = 5) in vec3 instColor;
+layout(location = 6) in float instRadius;
 layout(location = 0) out vec3 fragColor;
 
 void main() {
-	gl_Position = vec4(sceneData.rectCenter + inPos, 0.0, 1.0);
-	fragColor = inColor;
-}
\ No newline at end of file
+	float angle = sceneData.time + instPhase;
+	vec2 orbit = instRadius * vec2(cos(angle), sin(angle));
+	gl_Position = vec4(sceneData.rectCenter + instOffset + orbit + inPos * instScale, 0.0, 1.0);
+	fragColor = inColor * instColor;
+}
@@ -0,0 +1,116 @@
+#include "stagingRing.h"
+#include <stdexcept>
+
+void StagingRing::init(vk::Device device, DeviceAllocator& allocator, vk::DeviceSize capacity)
+{
+	this->allocator = &allocator;
+	this->capacity = capacity;
+
+	vk::BufferCreateInfo bufferCI;
+	bufferCI.size = capacity;
+	bufferCI.usage = vk::BufferUsageFlagBits::eTransferSrc;
+	bufferCI.sharingMode = vk::SharingMode::eExclusive;
+
+	buffer = device.createBufferUnique(bufferCI);
+
+	vk::MemoryRequirements memReq = device.getBufferMemoryRequirements(buffer.get());
+
+	// BAR領域を使わないようにデバイスローカルは避ける
+	MemoryUsage usage{ vk::MemoryPropertyFlagBits::eHostVisible, vk::MemoryPropertyFlagBits::eHostCoherent, vk::MemoryPropertyFlagBits::eDeviceLocal };
+	optional<uint32_t> memoryTypeIndex = allocator.findMemoryType(memReq.memoryTypeBits, usage);
+	if (!memoryTypeIndex.has_value())
+	{
+		throw runtime_error("failed to find a memory type for the staging ring!");
+	}
+
+	memory = UniqueAllocation(&allocator, allocator.allocate(memReq, memoryTypeIndex.value(), true));
+	device.bindBufferMemory(buffer.get(), memory->memory, memory->offset);
+}
+
+bool StagingRing::allocate(vk::DeviceSize size, vk::DeviceSize alignment, Region& region)
+{
+	if (size == 0 || size > capacity)
+	{
+		return false;
+	}
+	if (alignment == 0)
+	{
+		alignment = 1;
+	}
+
+	vk::DeviceSize inUse = closedBytes + openBytes;
+	if (inUse == 0)
+	{
+		head = tail = 0;
+	}
+	else if (head == tail)
+	{
+		return false; // 満杯
+	}
+
+	vk::DeviceSize offset = (head + alignment - 1) / alignment * alignment;
+	vk::DeviceSize bytes;
+
+	if (head >= tail)
+	{
+		// 空きは[head, capacity)と[0, tail)
+		if (offset + size <= capacity)
+		{
+			bytes = offset - head + size;
+		}
+		else if (size <= tail || inUse == 0)
+		{
+			// 末尾の余りは捨てて先頭に戻る
+			bytes = capacity - head + size;
+			offset = 0;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// 空きは[head, tail)
+		if (offset + size > tail)
+		{
+			return false;
+		}
+		bytes = offset - head + size;
+	}
+
+	head = offset + size;
+	openBytes += bytes;
+
+	region.buffer = buffer.get();
+	region.offset = offset;
+	region.size = size;
+	region.mapped = static_cast<char*>(memory->mapped) + offset;
+	return true;
+}
+
+void StagingRing::flush(const Region& region)
+{
+	allocator->flush(memory.get(), region.offset, region.size);
+}
+
+void StagingRing::close(uint64_t value)
+{
+	if (openBytes == 0)
+	{
+		return;
+	}
+	closedSpans.push_back(Span{ value, head, openBytes });
+	closedBytes += openBytes;
+	openBytes = 0;
+}
+
+void StagingRing::reclaim(uint64_t completedValue)
+{
+	while (!closedSpans.empty() && closedSpans.front().value <= completedValue)
+	{
+		tail = closedSpans.front().end;
+		closedBytes -= closedSpans.front().bytes;
+		closedSpans.pop_front();
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <deque>
+#include "deviceAllocator.h"
+
+using namespace std;
+
+// 常にマップされた1本のステージングバッファをリングとして使う
+// 割り当てはポインタを進めるだけで、使い終わった領域は提出の完了値（fenceの通し番号やタイムライン値）で回収する
+class StagingRing
+{
+public:
+	struct Region
+	{
+		vk::Buffer buffer;
+		vk::DeviceSize offset = 0;
+		vk::DeviceSize size = 0;
+		void* mapped = nullptr;
+	};
+
+	void init(vk::Device device, DeviceAllocator& allocator, vk::DeviceSize capacity);
+
+	// 空きがなければfalse。完了を待ってreclaim()してから再試行する
+	bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, Region& region);
+	void flush(const Region& region);
+
+	// 前回のclose()以降の割り当てを、完了値valueの提出が使うものとして閉じる
+	void close(uint64_t value);
+	// completedValueまでの提出が使った領域を再利用できるようにする
+	void reclaim(uint64_t completedValue);
+
+	vk::DeviceSize getCapacity() const { return capacity; }
+	bool hasPendingRegions() const { return !closedSpans.empty(); }
+	uint64_t getOldestPendingValue() const { return closedSpans.front().value; }
+
+private:
+	struct Span
+	{
+		uint64_t value;
+		vk::DeviceSize end; // この提出までの割り当ての終わり
+		vk::DeviceSize bytes; // 隙間も含めた使用量
+	};
+
+	DeviceAllocator* allocator = nullptr;
+	vk::UniqueBuffer buffer;
+	UniqueAllocation memory;
+	vk::DeviceSize capacity = 0;
+	vk::DeviceSize head = 0; // 次に割り当てる位置
+	vk::DeviceSize tail = 0; // 使用中の先頭
+	vk::DeviceSize closedBytes = 0;
+	vk::DeviceSize openBytes = 0; // まだclose()されていない割り当て
+	deque<Span> closedSpans;
+};
@@ -0,0 +1,281 @@
+#include "tlsf.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	uint32_t bitScanForward(uint64_t mask)
+	{
+#if defined(_MSC_VER) && defined(_WIN64)
+		unsigned long index;
+		_BitScanForward64(&index, mask);
+		return index;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanForward(&index, static_cast<unsigned long>(mask)))
+		{
+			return index;
+		}
+		_BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+		return index + 32;
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(mask));
+#endif
+	}
+
+	uint32_t bitScanReverse(uint64_t mask)
+	{
+#if defined(_MSC_VER) && defined(_WIN64)
+		unsigned long index;
+		_BitScanReverse64(&index, mask);
+		return index;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanReverse(&index, static_cast<unsigned long>(mask >> 32)))
+		{
+			return index + 32;
+		}
+		_BitScanReverse(&index, static_cast<unsigned long>(mask));
+		return index;
+#else
+		return 63 - static_cast<uint32_t>(__builtin_clzll(mask));
+#endif
+	}
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t size) : size(size), freeSize(size)
+{
+	for (auto& heads : freeHeads)
+	{
+		for (auto& head : heads)
+		{
+			head = invalidNode;
+		}
+	}
+
+	uint32_t node = newNode();
+	nodes[node].offset = 0;
+	nodes[node].size = size;
+	insertFree(node);
+}
+
+void TlsfAllocator::mapping(uint64_t size, uint32_t& fl, uint32_t& sl)
+{
+	// slCount未満はそのまま第2レベルの番号にする
+	if (size < slCount)
+	{
+		fl = 0;
+		sl = static_cast<uint32_t>(size);
+		return;
+	}
+	uint32_t msb = bitScanReverse(size);
+	sl = static_cast<uint32_t>(size >> (msb - slBits)) ^ slCount;
+	fl = msb - slBits + 1;
+}
+
+uint32_t TlsfAllocator::findFreeNode(uint64_t size)
+{
+	// 見つかったクラスのどのブロックでも収まるように要求を切り上げる
+	uint64_t roundedSize = size;
+	if (size >= slCount)
+	{
+		roundedSize += (1ull << (bitScanReverse(size) - slBits)) - 1;
+	}
+
+	uint32_t fl, sl;
+	mapping(roundedSize, fl, sl);
+	if (fl >= flCount)
+	{
+		return invalidNode;
+	}
+
+	uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+	if (slMap == 0)
+	{
+		uint64_t flMap = fl + 1 < flCount ? flBitmap & (~0ull << (fl + 1)) : 0;
+		if (flMap == 0)
+		{
+			// 切り上げで見落とす、要求と同じクラスのブロックを探す
+			mapping(size, fl, sl);
+			for (uint32_t node = freeHeads[fl][sl]; node != invalidNode; node = nodes[node].nextFree)
+			{
+				if (nodes[node].size >= size)
+				{
+					return node;
+				}
+			}
+			return invalidNode;
+		}
+		fl = bitScanForward(flMap);
+		slMap = slBitmaps[fl];
+	}
+	sl = bitScanForward(slMap);
+	return freeHeads[fl][sl];
+}
+
+void TlsfAllocator::insertFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	mapping(nodes[node].size, fl, sl);
+
+	Node& n = nodes[node];
+	n.isFree = true;
+	n.prevFree = invalidNode;
+	n.nextFree = freeHeads[fl][sl];
+	if (n.nextFree != invalidNode)
+	{
+		nodes[n.nextFree].prevFree = node;
+	}
+	freeHeads[fl][sl] = node;
+	flBitmap |= 1ull << fl;
+	slBitmaps[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::removeFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	mapping(nodes[node].size, fl, sl);
+
+	Node& n = nodes[node];
+	if (n.prevFree != invalidNode)
+	{
+		nodes[n.prevFree].nextFree = n.nextFree;
+	}
+	else
+	{
+		freeHeads[fl][sl] = n.nextFree;
+	}
+	if (n.nextFree != invalidNode)
+	{
+		nodes[n.nextFree].prevFree = n.prevFree;
+	}
+	n.isFree = false;
+	n.prevFree = invalidNode;
+	n.nextFree = invalidNode;
+
+	if (freeHeads[fl][sl] == invalidNode)
+	{
+		slBitmaps[fl] &= ~(1u << sl);
+		if (slBitmaps[fl] == 0)
+		{
+			flBitmap &= ~(1ull << fl);
+		}
+	}
+}
+
+uint32_t TlsfAllocator::newNode()
+{
+	if (unusedNodes != invalidNode)
+	{
+		uint32_t node = unusedNodes;
+		unusedNodes = nodes[node].nextFree;
+		nodes[node] = Node{};
+		return node;
+	}
+	nodes.push_back(Node{});
+	return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void TlsfAllocator::releaseNode(uint32_t node)
+{
+	nodes[node] = Node{};
+	nodes[node].nextFree = unusedNodes;
+	unusedNodes = node;
+}
+
+uint32_t TlsfAllocator::split(uint32_t node, uint64_t size)
+{
+	uint32_t rest = newNode();
+	Node& n = nodes[node];
+	Node& r = nodes[rest];
+	r.offset = n.offset + size;
+	r.size = n.size - size;
+	r.prevPhys = node;
+	r.nextPhys = n.nextPhys;
+	if (r.nextPhys != invalidNode)
+	{
+		nodes[r.nextPhys].prevPhys = rest;
+	}
+	n.nextPhys = rest;
+	n.size = size;
+	return rest;
+}
+
+bool TlsfAllocator::allocate(uint64_t size, uint64_t alignment, Allocation& allocation)
+{
+	if (size == 0 || size > freeSize)
+	{
+		return false;
+	}
+	if (alignment == 0)
+	{
+		alignment = 1;
+	}
+
+	uint32_t node = findFreeNode(size + alignment - 1);
+	if (node == invalidNode)
+	{
+		return false;
+	}
+	removeFree(node);
+
+	// アライメントのための前の隙間は空きブロックとして戻す
+	uint64_t alignedOffset = (nodes[node].offset + alignment - 1) / alignment * alignment;
+	uint64_t padding = alignedOffset - nodes[node].offset;
+	if (padding > 0)
+	{
+		uint32_t aligned = split(node, padding);
+		insertFree(node);
+		node = aligned;
+	}
+
+	if (nodes[node].size > size)
+	{
+		insertFree(split(node, size));
+	}
+
+	freeSize -= nodes[node].size;
+	allocation.offset = nodes[node].offset;
+	allocation.node = node;
+	return true;
+}
+
+void TlsfAllocator::free(uint32_t node)
+{
+	if (node == invalidNode || nodes[node].isFree)
+	{
+		return;
+	}
+	freeSize += nodes[node].size;
+
+	// 隣の空きブロックと結合する
+	uint32_t prev = nodes[node].prevPhys;
+	if (prev != invalidNode && nodes[prev].isFree)
+	{
+		removeFree(prev);
+		nodes[prev].size += nodes[node].size;
+		nodes[prev].nextPhys = nodes[node].nextPhys;
+		if (nodes[prev].nextPhys != invalidNode)
+		{
+			nodes[nodes[prev].nextPhys].prevPhys = prev;
+		}
+		releaseNode(node);
+		node = prev;
+	}
+
+	uint32_t next = nodes[node].nextPhys;
+	if (next != invalidNode && nodes[next].isFree)
+	{
+		removeFree(next);
+		nodes[node].size += nodes[next].size;
+		nodes[node].nextPhys = nodes[next].nextPhys;
+		if (nodes[node].nextPhys != invalidNode)
+		{
+			nodes[nodes[node].nextPhys].prevPhys = node;
+		}
+		releaseNode(next);
+	}
+
+	insertFree(node);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Two-Level Segregated Fitによる範囲の割り当て
+// 実際のメモリは持たず、[0, size)の中のオフセットだけを管理する。割り当てと解放はO(1)
+class TlsfAllocator
+{
+public:
+	static constexpr uint32_t invalidNode = UINT32_MAX;
+
+	struct Allocation
+	{
+		uint64_t offset = 0; // アライメント済みの先頭
+		uint32_t node = invalidNode;
+	};
+
+	TlsfAllocator() = default;
+	explicit TlsfAllocator(uint64_t size);
+
+	bool allocate(uint64_t size, uint64_t alignment, Allocation& allocation);
+	void free(uint32_t node);
+
+	uint64_t getSize() const { return size; }
+	uint64_t getFreeSize() const { return freeSize; }
+	bool isEmpty() const { return freeSize == size; }
+
+private:
+	static constexpr uint32_t slBits = 5;
+	static constexpr uint32_t slCount = 1u << slBits;
+	static constexpr uint32_t flCount = 64;
+
+	struct Node
+	{
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint32_t prevPhys = invalidNode; // アドレス順で隣のブロック
+		uint32_t nextPhys = invalidNode;
+		uint32_t prevFree = invalidNode; // 同じ大きさのクラスの空きリスト
+		uint32_t nextFree = invalidNode;
+		bool isFree = false;
+	};
+
+	static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+	uint32_t findFreeNode(uint64_t size);
+	void insertFree(uint32_t node);
+	void removeFree(uint32_t node);
+	uint32_t newNode();
+	void releaseNode(uint32_t node);
+	uint32_t split(uint32_t node, uint64_t size); // 後ろ側を新しい空きブロックにする
+
+	uint64_t size = 0;
+	uint64_t freeSize = 0;
+	uint64_t flBitmap = 0;
+	uint32_t slBitmaps[flCount] = {};
+	uint32_t freeHeads[flCount][slCount];
+	vector<Node> nodes;
+	uint32_t unusedNodes = invalidNode; // 再利用できるNodeの連結リスト
+};
@@ -0,0 +1,311 @@
+#include "uploadContext.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void UploadContext::init(vk::Device device, vk::Queue queue, uint32_t queueFamilyIndex, uint32_t graphicsQueueFamilyIndex, uint32_t framesInFlight, StagingRing& stagingRing)
+{
+	this->device = device;
+	this->queue = queue;
+	this->queueFamilyIndex = queueFamilyIndex;
+	this->graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+	this->stagingRing = &stagingRing;
+	frameSemaphores.resize(framesInFlight);
+}
+
+UploadContext::Batch UploadContext::acquireBatch()
+{
+	if (!freeBatches.empty())
+	{
+		Batch batch = std::move(freeBatches.back());
+		freeBatches.pop_back();
+		device.resetCommandPool(batch.commandPool.get());
+		device.resetFences({ batch.fence.get() });
+		batch.bufferAcquires.clear();
+		batch.imageAcquires.clear();
+		return batch;
+	}
+
+	Batch batch;
+
+	vk::CommandPoolCreateInfo cmdPoolCI;
+	cmdPoolCI.queueFamilyIndex = queueFamilyIndex;
+	cmdPoolCI.flags = vk::CommandPoolCreateFlagBits::eTransient;
+	batch.commandPool = device.createCommandPoolUnique(cmdPoolCI);
+
+	vk::CommandBufferAllocateInfo cmdBufAllocInfo;
+	cmdBufAllocInfo.commandPool = batch.commandPool.get();
+	cmdBufAllocInfo.commandBufferCount = 1;
+	cmdBufAllocInfo.level = vk::CommandBufferLevel::ePrimary;
+	batch.commandBuffer = std::move(device.allocateCommandBuffersUnique(cmdBufAllocInfo)[0]);
+
+	batch.fence = device.createFenceUnique(vk::FenceCreateInfo{});
+	return batch;
+}
+
+vk::Semaphore UploadContext::acquireSemaphore()
+{
+	if (!freeSemaphores.empty())
+	{
+		vk::Semaphore semaphore = freeSemaphores.back();
+		freeSemaphores.pop_back();
+		return semaphore;
+	}
+
+	semaphores.push_back(device.createSemaphoreUnique(vk::SemaphoreCreateInfo{}));
+	return semaphores.back().get();
+}
+
+vk::CommandBuffer UploadContext::beginBatch()
+{
+	if (!recording)
+	{
+		current = acquireBatch();
+
+		vk::CommandBufferBeginInfo cmdBeginInfo;
+		cmdBeginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		current.commandBuffer->begin(cmdBeginInfo);
+		recording = true;
+	}
+	return current.commandBuffer.get();
+}
+
+StagingRing::Region UploadContext::stage(const void* data, vk::DeviceSize size, vk::DeviceSize alignment)
+{
+	StagingRing::Region region;
+	while (!stagingRing->allocate(size, alignment, region))
+	{
+		// 記録中の分を先に提出し、一番古い提出の完了を待って領域を空ける
+		if (recording)
+		{
+			submit();
+		}
+		if (!stagingRing->hasPendingRegions())
+		{
+			throw runtime_error("upload does not fit in the staging ring!");
+		}
+		wait(stagingRing->getOldestPendingValue());
+	}
+
+	memcpy(region.mapped, data, size);
+	stagingRing->flush(region);
+	return region;
+}
+
+void UploadContext::copyToBuffer(vk::Buffer dstBuffer, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	// リングを使い切らないように分割して、前の塊の転送中に次を書き込めるようにする
+	vk::DeviceSize maxChunk = std::max<vk::DeviceSize>(stagingRing->getCapacity() / 4, 1);
+	const char* src = static_cast<const char*>(data);
+
+	for (vk::DeviceSize copied = 0; copied < size;)
+	{
+		vk::DeviceSize chunkSize = std::min(size - copied, maxChunk);
+		StagingRing::Region region = stage(src + copied, chunkSize, 16);
+
+		vk::BufferCopy bufferCopy;
+		bufferCopy.srcOffset = region.offset;
+		bufferCopy.dstOffset = dstOffset + copied;
+		bufferCopy.size = chunkSize;
+
+		beginBatch().copyBuffer(region.buffer, dstBuffer, { bufferCopy });
+		copied += chunkSize;
+	}
+
+	if (usesOwnershipTransfer())
+	{
+		// 書き込んだ範囲の所有権を解放し、同じ内容の獲得をグラフィックス側で行う
+		vk::BufferMemoryBarrier release;
+		release.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		release.dstAccessMask = {};
+		release.srcQueueFamilyIndex = queueFamilyIndex;
+		release.dstQueueFamilyIndex = graphicsQueueFamilyIndex;
+		release.buffer = dstBuffer;
+		release.offset = dstOffset;
+		release.size = size;
+		current.commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, { release }, {});
+
+		vk::BufferMemoryBarrier acquire = release;
+		acquire.srcAccessMask = {};
+		acquire.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead |
+			vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndirectCommandRead;
+		current.bufferAcquires.push_back(acquire);
+	}
+}
+
+void UploadContext::copyToImage(vk::Image dstImage, const vk::Extent3D& extent, vk::ImageAspectFlags aspect, const void* data, vk::DeviceSize size, vk::ImageLayout finalLayout)
+{
+	// テクセルブロックの境界に揃うように16バイトでアライメントする
+	StagingRing::Region region = stage(data, size, 16);
+	vk::CommandBuffer commandBuffer = beginBatch();
+
+	vk::ImageSubresourceRange range;
+	range.aspectMask = aspect;
+	range.baseMipLevel = 0;
+	range.levelCount = 1;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	vk::ImageMemoryBarrier toTransfer;
+	toTransfer.srcAccessMask = {};
+	toTransfer.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+	toTransfer.oldLayout = vk::ImageLayout::eUndefined;
+	toTransfer.newLayout = vk::ImageLayout::eTransferDstOptimal;
+	toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toTransfer.image = dstImage;
+	toTransfer.subresourceRange = range;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, { toTransfer });
+
+	vk::BufferImageCopy copyRegion;
+	copyRegion.bufferOffset = region.offset;
+	copyRegion.bufferRowLength = 0;
+	copyRegion.bufferImageHeight = 0;
+	copyRegion.imageSubresource.aspectMask = aspect;
+	copyRegion.imageSubresource.mipLevel = 0;
+	copyRegion.imageSubresource.baseArrayLayer = 0;
+	copyRegion.imageSubresource.layerCount = 1;
+	copyRegion.imageOffset = vk::Offset3D{ 0, 0, 0 };
+	copyRegion.imageExtent = extent;
+	commandBuffer.copyBufferToImage(region.buffer, dstImage, vk::ImageLayout::eTransferDstOptimal, { copyRegion });
+
+	vk::ImageMemoryBarrier toFinal = toTransfer;
+	toFinal.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	toFinal.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+	toFinal.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+	toFinal.newLayout = finalLayout;
+
+	if (usesOwnershipTransfer())
+	{
+		// レイアウトの遷移は解放と獲得の両方に同じ値で書く
+		toFinal.dstAccessMask = {};
+		toFinal.srcQueueFamilyIndex = queueFamilyIndex;
+		toFinal.dstQueueFamilyIndex = graphicsQueueFamilyIndex;
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, { toFinal });
+
+		vk::ImageMemoryBarrier acquire = toFinal;
+		acquire.srcAccessMask = {};
+		acquire.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		current.imageAcquires.push_back(acquire);
+		return;
+	}
+
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {}, { toFinal });
+}
+
+UploadContext::Ticket UploadContext::submit()
+{
+	if (!recording)
+	{
+		return nextTicket - 1;
+	}
+
+	if (!usesOwnershipTransfer())
+	{
+		// 後から提出される描画コマンドが転送結果を読めるようにする
+		vk::MemoryBarrier visibilityBarrier;
+		visibilityBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		visibilityBarrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead |
+			vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndirectCommandRead;
+		current.commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, { visibilityBarrier }, {}, {});
+	}
+
+	current.commandBuffer->end();
+
+	vk::CommandBuffer submitCmdBufs[1] = { current.commandBuffer.get() };
+
+	vk::SubmitInfo submitInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = submitCmdBufs;
+
+	vk::Semaphore signalSemaphores[1];
+	if (usesOwnershipTransfer())
+	{
+		// グラフィックスキューはこのセマフォを待ってから獲得バリアを実行する
+		signalSemaphores[0] = acquireSemaphore();
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = signalSemaphores;
+
+		Handoff handoff;
+		handoff.semaphore = signalSemaphores[0];
+		handoff.bufferAcquires = std::move(current.bufferAcquires);
+		handoff.imageAcquires = std::move(current.imageAcquires);
+		pendingHandoffs.push_back(std::move(handoff));
+	}
+
+	queue.submit({ submitInfo }, current.fence.get());
+
+	current.ticket = nextTicket++;
+	stagingRing->close(current.ticket);
+	inFlight.push_back(std::move(current));
+	recording = false;
+
+	return inFlight.back().ticket;
+}
+
+void UploadContext::collect()
+{
+	while (!inFlight.empty() && device.getFenceStatus(inFlight.front().fence.get()) == vk::Result::eSuccess)
+	{
+		completedTicket = inFlight.front().ticket;
+		freeBatches.push_back(std::move(inFlight.front()));
+		inFlight.pop_front();
+	}
+	stagingRing->reclaim(completedTicket);
+}
+
+bool UploadContext::isComplete(Ticket ticket)
+{
+	if (ticket > completedTicket)
+	{
+		collect();
+	}
+	return ticket <= completedTicket;
+}
+
+void UploadContext::wait(Ticket ticket)
+{
+	if (ticket >= nextTicket)
+	{
+		// まだ提出されていない分を含むなら先に提出する
+		submit();
+	}
+
+	for (const Batch& batch : inFlight)
+	{
+		if (batch.ticket >= ticket)
+		{
+			(void)device.waitForFences({ batch.fence.get() }, VK_TRUE, UINT64_MAX);
+			break;
+		}
+	}
+	collect();
+}
+
+void UploadContext::acquireOwnership(vk::CommandBuffer commandBuffer, uint32_t frameIndex, vector<vk::Semaphore>& waitSemaphores, vector<vk::PipelineStageFlags>& waitStages)
+{
+	for (Handoff& handoff : pendingHandoffs)
+	{
+		// セマフォの待機でコピーの完了が保証されるので、獲得バリアは待機したステージから始める
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, {}, handoff.bufferAcquires, handoff.imageAcquires);
+
+		waitSemaphores.push_back(handoff.semaphore);
+		waitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+		frameSemaphores[frameIndex].push_back(handoff.semaphore);
+	}
+	pendingHandoffs.clear();
+}
+
+void UploadContext::releaseFrame(uint32_t frameIndex)
+{
+	for (vk::Semaphore semaphore : frameSemaphores[frameIndex])
+	{
+		freeSemaphores.push_back(semaphore);
+	}
+	frameSemaphores[frameIndex].clear();
+}
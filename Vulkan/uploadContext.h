@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <deque>
+#include <vector>
+#include "stagingRing.h"
+
+using namespace std;
+
+// 任意の数のバッファ/イメージへの転送を1つのコマンドバッファにまとめて1回で提出する
+// 提出ごとにチケット（増え続ける値）を返し、fenceで完了を確認する。同じキューのfenceは提出順に完了するので、
+// あるチケットが完了していればそれより前のチケットもすべて完了している
+// 転送専用のキューファミリーで動かすときは、解放バリアとセマフォをグラフィックス側の獲得バリアと組にして所有権を移す
+class UploadContext
+{
+public:
+	using Ticket = uint64_t;
+
+	void init(vk::Device device, vk::Queue queue, uint32_t queueFamilyIndex, uint32_t graphicsQueueFamilyIndex, uint32_t framesInFlight, StagingRing& stagingRing);
+
+	// 記録中のバッチに追加する。リングに空きがなければ途中で提出して空くのを待つ
+	void copyToBuffer(vk::Buffer dstBuffer, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size);
+	// 全体をeTransferDstOptimalにしてコピーし、finalLayoutへ遷移させる
+	void copyToImage(vk::Image dstImage, const vk::Extent3D& extent, vk::ImageAspectFlags aspect, const void* data, vk::DeviceSize size, vk::ImageLayout finalLayout);
+
+	// 記録したものを提出する。何も記録していなければ直前のチケットを返す
+	Ticket submit();
+	bool isComplete(Ticket ticket);
+	void wait(Ticket ticket);
+	// 完了したバッチのコマンドバッファとリングの領域を回収する
+	void collect();
+
+	// 提出済みの転送の獲得バリアをグラフィックスのコマンドバッファに記録し、待つべきセマフォを追加する
+	// 転送キューで完了していても、ここで獲得するまでグラフィックス側からは使えない
+	void acquireOwnership(vk::CommandBuffer commandBuffer, uint32_t frameIndex, vector<vk::Semaphore>& waitSemaphores, vector<vk::PipelineStageFlags>& waitStages);
+	// フレームのfenceを待った後に呼び、そのフレームが待ったセマフォを再利用に回す
+	void releaseFrame(uint32_t frameIndex);
+
+	Ticket getLastSubmitted() const { return nextTicket - 1; }
+	bool usesOwnershipTransfer() const { return queueFamilyIndex != graphicsQueueFamilyIndex; }
+
+private:
+	struct Batch
+	{
+		vk::UniqueCommandPool commandPool;
+		vk::UniqueCommandBuffer commandBuffer;
+		vk::UniqueFence fence;
+		Ticket ticket = 0;
+		vector<vk::BufferMemoryBarrier> bufferAcquires;
+		vector<vk::ImageMemoryBarrier> imageAcquires;
+	};
+
+	// グラフィックスキューに引き渡す前の転送
+	struct Handoff
+	{
+		vk::Semaphore semaphore;
+		vector<vk::BufferMemoryBarrier> bufferAcquires;
+		vector<vk::ImageMemoryBarrier> imageAcquires;
+	};
+
+	vk::CommandBuffer beginBatch();
+	StagingRing::Region stage(const void* data, vk::DeviceSize size, vk::DeviceSize alignment);
+	Batch acquireBatch();
+	vk::Semaphore acquireSemaphore();
+
+	vk::Device device;
+	vk::Queue queue;
+	uint32_t queueFamilyIndex = 0;
+	uint32_t graphicsQueueFamilyIndex = 0;
+	StagingRing* stagingRing = nullptr;
+
+	bool recording = false;
+	Batch current;
+	deque<Batch> inFlight; // 提出順
+	vector<Batch> freeBatches;
+	vector<Handoff> pendingHandoffs;
+	vector<vk::UniqueSemaphore> semaphores;
+	vector<vk::Semaphore> freeSemaphores;
+	vector<vector<vk::Semaphore>> frameSemaphores; // フレームごとに待ったセマフォ
+	Ticket nextTicket = 1;
+	Ticket completedTicket = 0;
+};
@@ -0,0 +1,273 @@
+#include "vertexFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define VERTEX_FORMAT_SSE2
+#endif
+
+VertexLayout getVertexLayout(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Half:
+		return { sizeof(VertexHalf), VertexInputLayout<VertexHalf, InstanceData>::createInfo() };
+	case VertexFormat::Snorm16:
+		return { sizeof(VertexSnorm16), VertexInputLayout<VertexSnorm16, InstanceData>::createInfo() };
+	default:
+		return { sizeof(Vertex), VertexInputLayout<Vertex, InstanceData>::createInfo() };
+	}
+}
+
+const char* vertexFormatName(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Half:
+		return "half";
+	case VertexFormat::Snorm16:
+		return "snorm16";
+	default:
+		return "float32";
+	}
+}
+
+bool parseVertexFormat(string_view name, VertexFormat& format)
+{
+	for (VertexFormat candidate : { VertexFormat::Float32, VertexFormat::Half, VertexFormat::Snorm16 })
+	{
+		if (name == vertexFormatName(candidate))
+		{
+			format = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint16_t floatToHalf(float value)
+{
+	// 最近接偶数丸め。SSE2版と同じ手順で、分岐の代わりにマスクで選んでいる
+	uint32_t x;
+	memcpy(&x, &value, sizeof(x));
+	uint32_t sign = x & 0x80000000u;
+	x ^= sign;
+
+	uint32_t result;
+	if (x >= (127u + 16u) << 23)
+	{
+		// 表せない大きさは無限大、NaNはNaNのまま
+		result = x > (255u << 23) ? 0x7e00u : 0x7c00u;
+	}
+	else if (x < (113u << 23))
+	{
+		// 非正規化数は加算で仮数部を右に寄せて丸める
+		const uint32_t denormMagicBits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+		float denormMagic;
+		memcpy(&denormMagic, &denormMagicBits, sizeof(denormMagic));
+		float f;
+		memcpy(&f, &x, sizeof(f));
+		f += denormMagic;
+		memcpy(&x, &f, sizeof(x));
+		result = x - denormMagicBits;
+	}
+	else
+	{
+		uint32_t mantissaOdd = (x >> 13) & 1u;
+		x += ((15u - 127u) << 23) + 0xfffu;
+		x += mantissaOdd;
+		result = x >> 13;
+	}
+	return static_cast<uint16_t>(result | (sign >> 16));
+}
+
+#ifdef VERTEX_FORMAT_SSE2
+static __m128i floatToHalf4(__m128 value)
+{
+	const __m128i signMask = _mm_set1_epi32(static_cast<int>(0x80000000u));
+	const __m128i denormMagicBits = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+
+	__m128i x = _mm_castps_si128(value);
+	__m128i sign = _mm_and_si128(x, signMask);
+	x = _mm_xor_si128(x, sign);
+
+	__m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(1));
+	__m128i normal = _mm_add_epi32(x, _mm_set1_epi32(static_cast<int>(((15u - 127u) << 23) + 0xfffu)));
+	normal = _mm_srli_epi32(_mm_add_epi32(normal, mantissaOdd), 13);
+
+	__m128i denorm = _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(x), _mm_castsi128_ps(denormMagicBits)));
+	denorm = _mm_sub_epi32(denorm, denormMagicBits);
+
+	__m128i isNan = _mm_cmpgt_epi32(x, _mm_set1_epi32(255 << 23));
+	__m128i infNan = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(isNan, _mm_set1_epi32(0x0200)));
+
+	__m128i isDenorm = _mm_cmpgt_epi32(_mm_set1_epi32(113 << 23), x);
+	__m128i isInf = _mm_cmpgt_epi32(x, _mm_set1_epi32(((127 + 16) << 23) - 1));
+
+	__m128i result = _mm_or_si128(_mm_and_si128(isDenorm, denorm), _mm_andnot_si128(isDenorm, normal));
+	result = _mm_or_si128(_mm_and_si128(isInf, infNan), _mm_andnot_si128(isInf, result));
+	return _mm_or_si128(result, _mm_srli_epi32(sign, 16));
+}
+
+// 下位16ビットを符号拡張してから詰めるので、飽和せずにビット列がそのまま残る
+static __m128i packLow16(__m128i value)
+{
+	value = _mm_srai_epi32(_mm_slli_epi32(value, 16), 16);
+	return _mm_packs_epi32(value, value);
+}
+#endif
+
+void encodeHalf(const float* src, uint16_t* dst, size_t count)
+{
+	size_t i = 0;
+#ifdef VERTEX_FORMAT_SSE2
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i packed = packLow16(floatToHalf4(_mm_loadu_ps(src + i)));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), packed);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		dst[i] = floatToHalf(src[i]);
+	}
+}
+
+void encodeSnorm16(const float* src, int16_t* dst, size_t count)
+{
+	size_t i = 0;
+#ifdef VERTEX_FORMAT_SSE2
+	const __m128 minValue = _mm_set1_ps(-1.0f);
+	const __m128 maxValue = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(32767.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), minValue), maxValue);
+		__m128i rounded = _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(rounded, rounded));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float value = std::min(std::max(src[i], -1.0f), 1.0f);
+		dst[i] = static_cast<int16_t>(lrintf(value * 32767.0f));
+	}
+}
+
+void encodeUnorm8(const float* src, uint8_t* dst, size_t count)
+{
+	size_t i = 0;
+#ifdef VERTEX_FORMAT_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+		__m128i rounded = _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+		__m128i packed16 = _mm_packs_epi32(rounded, rounded);
+		int packed8 = _mm_cvtsi128_si32(_mm_packus_epi16(packed16, packed16));
+		memcpy(dst + i, &packed8, sizeof(packed8));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float value = std::min(std::max(src[i], 0.0f), 1.0f);
+		dst[i] = static_cast<uint8_t>(lrintf(value * 255.0f));
+	}
+}
+
+vector<uint8_t> encodeVertices(const vector<Vertex>& vertices, VertexFormat format)
+{
+	vector<uint8_t> result(vertices.size() * getVertexLayout(format).stride);
+	if (format == VertexFormat::Float32)
+	{
+		if (!vertices.empty())
+		{
+			memcpy(result.data(), vertices.data(), result.size());
+		}
+		return result;
+	}
+
+	// 成分ごとに連続した配列に並べ直してからまとめて変換する
+	vector<float> positions(vertices.size() * 2);
+	vector<float> colors(vertices.size() * 4);
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		positions[i * 2 + 0] = vertices[i].pos.x;
+		positions[i * 2 + 1] = vertices[i].pos.y;
+		colors[i * 4 + 0] = vertices[i].color.x;
+		colors[i * 4 + 1] = vertices[i].color.y;
+		colors[i * 4 + 2] = vertices[i].color.z;
+		colors[i * 4 + 3] = 1.0f;
+	}
+
+	vector<uint16_t> encodedPositions(positions.size());
+	if (format == VertexFormat::Half)
+	{
+		encodeHalf(positions.data(), encodedPositions.data(), positions.size());
+	}
+	else
+	{
+		encodeSnorm16(positions.data(), reinterpret_cast<int16_t*>(encodedPositions.data()), positions.size());
+	}
+
+	vector<uint8_t> encodedColors(colors.size());
+	encodeUnorm8(colors.data(), encodedColors.data(), colors.size());
+
+	// HalfとSnorm16はどちらも16ビット2成分と8ビット4成分の並びなので同じ書き方でよい
+	static_assert(sizeof(VertexHalf) == sizeof(VertexSnorm16) && offsetof(VertexHalf, color) == offsetof(VertexSnorm16, color));
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		VertexHalf vertex;
+		memcpy(&vertex.pos, &encodedPositions[i * 2], sizeof(vertex.pos));
+		memcpy(&vertex.color, &encodedColors[i * 4], sizeof(vertex.color));
+		memcpy(result.data() + i * sizeof(VertexHalf), &vertex, sizeof(vertex));
+	}
+	return result;
+}
+
+uint32_t encodeOctahedral(const Vec3& normal)
+{
+	float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if (length == 0.0f)
+	{
+		return 0;
+	}
+
+	float x = normal.x / length;
+	float y = normal.y / length;
+	if (normal.z < 0.0f)
+	{
+		// 下半分は対角線で折り返す
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	float values[2] = { x, y };
+	int16_t encoded[2];
+	encodeSnorm16(values, encoded, 2);
+	return static_cast<uint16_t>(encoded[0]) | (static_cast<uint32_t>(static_cast<uint16_t>(encoded[1])) << 16);
+}
+
+Vec3 decodeOctahedral(uint32_t encoded)
+{
+	float x = std::max(static_cast<int16_t>(encoded & 0xffff) / 32767.0f, -1.0f);
+	float y = std::max(static_cast<int16_t>(encoded >> 16) / 32767.0f, -1.0f);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	if (z < 0.0f)
+	{
+		float unfoldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float unfoldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	float length = sqrtf(x * x + y * y + z * z);
+	return Vec3{ x / length, y / length, z / length };
+}
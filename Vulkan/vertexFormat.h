@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+#include "vertex.h"
+#include "vertexLayout.h"
+#include "instanceData.h"
+
+using namespace std;
+
+// GPUに置く頂点の形式。Vertex（20バイト）からエンコードして転送する
+enum class VertexFormat
+{
+	Float32, // pos: R32G32Sfloat, color: R32G32B32Sfloat（20バイト）
+	Half, // pos: R16G16Sfloat, color: R8G8B8A8Unorm（8バイト）
+	Snorm16, // pos: R16G16Snorm, color: R8G8B8A8Unorm（8バイト）。座標は[-1, 1]に丸められる
+};
+
+struct VertexHalf
+{
+	Half2 pos;
+	Unorm8x4 color;
+};
+
+struct VertexSnorm16
+{
+	Snorm16x2 pos;
+	Unorm8x4 color;
+};
+
+template<> struct VertexTraits<VertexHalf>
+{
+	static constexpr vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex;
+	static constexpr array<VertexAttribute, 2> attributes = {
+		VERTEX_ATTRIBUTE(VertexHalf, pos, 0),
+		VERTEX_ATTRIBUTE(VertexHalf, color, 1), // シェーダーのvec3には先頭の3成分が入る
+	};
+};
+
+template<> struct VertexTraits<VertexSnorm16>
+{
+	static constexpr vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex;
+	static constexpr array<VertexAttribute, 2> attributes = {
+		VERTEX_ATTRIBUTE(VertexSnorm16, pos, 0),
+		VERTEX_ATTRIBUTE(VertexSnorm16, color, 1),
+	};
+};
+
+// 実行時に選んだ形式の頂点入力。binding 0が頂点、binding 1がインスタンス
+// inputStateはVertexInputLayoutの静的な配列を指し、strideは頂点の大きさ
+struct VertexLayout
+{
+	uint32_t stride;
+	vk::PipelineVertexInputStateCreateInfo inputState;
+};
+
+VertexLayout getVertexLayout(VertexFormat format);
+const char* vertexFormatName(VertexFormat format);
+// "float32", "half", "snorm16"のどれか
+bool parseVertexFormat(string_view name, VertexFormat& format);
+// GPUの形式にエンコードした頂点を返す。Float32ならそのままコピーする
+vector<uint8_t> encodeVertices(const vector<Vertex>& vertices, VertexFormat format);
+
+// 連続したfloatをまとめて変換する。x86ではSSE2で4個ずつ処理する
+void encodeHalf(const float* src, uint16_t* dst, size_t count);
+void encodeSnorm16(const float* src, int16_t* dst, size_t count);
+void encodeUnorm8(const float* src, uint8_t* dst, size_t count);
+
+uint16_t floatToHalf(float value);
+
+// 単位ベクトルを八面体に投影してsnorm16の2成分（下位16ビットがx）に詰める
+uint32_t encodeOctahedral(const Vec3& normal);
+Vec3 decodeOctahedral(uint32_t encoded);
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "vertex.h"
+
+using namespace std;
+
+// 頂点の構造体から頂点入力の記述をコンパイル時に作る
+//
+//   template<> struct VertexTraits<MyVertex>
+//   {
+//       static constexpr vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex;
+//       static constexpr array<VertexAttribute, 2> attributes = {
+//           VERTEX_ATTRIBUTE(MyVertex, pos, 0),
+//           VERTEX_ATTRIBUTE(MyVertex, color, 1),
+//       };
+//   };
+//
+// VertexInputLayout<A, B>のようにストリームを並べると、A, Bがそれぞれbinding 0, 1になる
+
+// メンバの型から頂点属性の形式を決める
+template<class T> struct VertexAttributeFormat;
+template<> struct VertexAttributeFormat<float> { static constexpr vk::Format value = vk::Format::eR32Sfloat; };
+template<> struct VertexAttributeFormat<Vec2> { static constexpr vk::Format value = vk::Format::eR32G32Sfloat; };
+template<> struct VertexAttributeFormat<Vec3> { static constexpr vk::Format value = vk::Format::eR32G32B32Sfloat; };
+
+// 圧縮した形式のための型。ビット列を持つだけで演算はしない
+struct Half2 { uint16_t x, y; };
+struct Snorm16x2 { int16_t x, y; };
+struct Unorm8x4 { uint8_t x, y, z, w; };
+
+template<> struct VertexAttributeFormat<Half2> { static constexpr vk::Format value = vk::Format::eR16G16Sfloat; };
+template<> struct VertexAttributeFormat<Snorm16x2> { static constexpr vk::Format value = vk::Format::eR16G16Snorm; };
+template<> struct VertexAttributeFormat<Unorm8x4> { static constexpr vk::Format value = vk::Format::eR8G8B8A8Unorm; };
+
+struct VertexAttribute
+{
+	uint32_t location;
+	vk::Format format;
+	uint32_t offset;
+};
+
+#define VERTEX_ATTRIBUTE(type, member, location) \
+	VertexAttribute{ location, VertexAttributeFormat<decltype(type::member)>::value, static_cast<uint32_t>(offsetof(type, member)) }
+
+template<class T> struct VertexTraits;
+
+struct FlatVertexAttribute
+{
+	uint32_t location = 0;
+	uint32_t binding = 0;
+	vk::Format format = vk::Format::eUndefined;
+	uint32_t offset = 0;
+};
+
+template<class... Streams>
+constexpr uint32_t vertexAttributeCount = static_cast<uint32_t>((VertexTraits<Streams>::attributes.size() + ...));
+
+// 全ストリームの属性を、ストリームの順番をbindingにして1つの配列に並べる
+template<class... Streams>
+constexpr array<FlatVertexAttribute, vertexAttributeCount<Streams...>> flattenVertexAttributes()
+{
+	array<FlatVertexAttribute, vertexAttributeCount<Streams...>> result{};
+	uint32_t count = 0;
+	uint32_t binding = 0;
+	([&]() {
+		for (const VertexAttribute& attribute : VertexTraits<Streams>::attributes)
+		{
+			result[count++] = FlatVertexAttribute{ attribute.location, binding, attribute.format, attribute.offset };
+		}
+		binding++;
+	}(), ...);
+	return result;
+}
+
+template<size_t N>
+constexpr bool hasUniqueLocations(const array<FlatVertexAttribute, N>& attributes)
+{
+	for (size_t i = 0; i < N; i++)
+	{
+		for (size_t j = i + 1; j < N; j++)
+		{
+			if (attributes[i].location == attributes[j].location)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template<class... Streams, size_t... B>
+constexpr array<vk::VertexInputBindingDescription, sizeof...(Streams)> makeVertexBindings(index_sequence<B...>)
+{
+	return { vk::VertexInputBindingDescription(static_cast<uint32_t>(B), static_cast<uint32_t>(sizeof(Streams)), VertexTraits<Streams>::inputRate)... };
+}
+
+template<size_t N, size_t... I>
+constexpr array<vk::VertexInputAttributeDescription, N> makeVertexAttributes(const array<FlatVertexAttribute, N>& attributes, index_sequence<I...>)
+{
+	return { vk::VertexInputAttributeDescription(attributes[I].location, attributes[I].binding, attributes[I].format, attributes[I].offset)... };
+}
+
+template<class... Streams>
+class VertexInputLayout
+{
+	static constexpr array<FlatVertexAttribute, vertexAttributeCount<Streams...>> flatAttributes = flattenVertexAttributes<Streams...>();
+	static_assert(hasUniqueLocations(flatAttributes), "vertex attribute locations must be unique across all streams");
+
+public:
+	static constexpr uint32_t bindingCount = sizeof...(Streams);
+	static constexpr uint32_t attributeCount = vertexAttributeCount<Streams...>;
+
+	static constexpr array<vk::VertexInputBindingDescription, bindingCount> bindings = makeVertexBindings<Streams...>(index_sequence_for<Streams...>{});
+	static constexpr array<vk::VertexInputAttributeDescription, attributeCount> attributes = makeVertexAttributes(flatAttributes, make_index_sequence<attributeCount>{});
+
+	// 指す先は静的な配列なので、作ったcreate infoはいつまでも使える
+	static vk::PipelineVertexInputStateCreateInfo createInfo()
+	{
+		vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
+		vertexInputInfo.vertexBindingDescriptionCount = bindingCount;
+		vertexInputInfo.pVertexBindingDescriptions = bindings.data();
+		vertexInputInfo.vertexAttributeDescriptionCount = attributeCount;
+		vertexInputInfo.pVertexAttributeDescriptions = attributes.data();
+		return vertexInputInfo;
+	}
+};
+
+template<> struct VertexTraits<Vertex>
+{
+	static constexpr vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex;
+	static constexpr array<VertexAttribute, 2> attributes = {
+		VERTEX_ATTRIBUTE(Vertex, pos, 0),
+		VERTEX_ATTRIBUTE(Vertex, color, 1),
+	};
+};
+
+// 位置とそれ以外を別のバッファに分けたストリーム。深度だけのパスでは位置のストリームだけを読めばよい
+struct PositionStream
+{
+	Vec2 pos;
+};
+
+struct ColorStream
+{
+	Vec3 color;
+};
+
+template<> struct VertexTraits<PositionStream>
+{
+	static constexpr vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex;
+	static constexpr array<VertexAttribute, 1> attributes = {
+		VERTEX_ATTRIBUTE(PositionStream, pos, 0),
+	};
+};
+
+template<> struct VertexTraits<ColorStream>
+{
+	static constexpr vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex;
+	static constexpr array<VertexAttribute, 1> attributes = {
+		VERTEX_ATTRIBUTE(ColorStream, color, 1),
+	};
+};
+
+using InterleavedVertexLayout = VertexInputLayout<Vertex>;
+using PositionOnlyVertexLayout = VertexInputLayout<PositionStream>;
+using SplitVertexLayout = VertexInputLayout<PositionStream, ColorStream>;
@@ -1,85 +1,280 @@
 #include "vulkan.h"
 
+Vulkan::Vulkan(const EngineConfig& config) : config(config)
+{
+	if (this->config.framesInFlight == 0)
+	{
+		this->config.framesInFlight = 1;
+	}
+}
+
+void Vulkan::addMesh(Mesh mesh)
+{
+	meshes.push_back(std::move(mesh));
+	meshInstances.emplace_back();
+}
+
+void Vulkan::addInstancedMesh(Mesh mesh, vector<InstanceData> instances)
+{
+	meshes.push_back(std::move(mesh));
+	meshInstances.push_back(std::move(instances));
+}
+
+uint32_t Vulkan::addAssetPack(const char* fileName)
+{
+	if (!assetPack.open(fileName))
+	{
+		throw runtime_error(string("failed to open asset pack: ") + fileName);
+	}
+
+	packMeshCount = 0;
+	for (uint32_t i = 0; i < assetPack.getEntryCount(); i++)
+	{
+		if (assetPack.getEntry(i).type == AssetType::Mesh)
+		{
+			packMeshCount++;
+		}
+	}
+	return packMeshCount;
+}
+
 void Vulkan::run()
 {
 	init();
 
-	void* pUniformBufMem = device->mapMemory(uniformBufMem.get(), 0, sizeof(SceneData));
-
 	float time = 0;
+	auto loopStart = chrono::steady_clock::now();
+
+	while (!shouldClose()) {
+		CpuProfiler::ScopedTimer frameTimer(cpuProfiler, FramePhase::Frame);
+
+		if (!config.headless)
+		{
+			CpuProfiler::ScopedTimer timer(cpuProfiler, FramePhase::PollEvents);
+			glfwPollEvents();
+
+			// F12で計測結果をその場で書き出す
+			bool dumpKey = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+			if (dumpKey && !dumpKeyPressed)
+			{
+				dumpCpuProfile();
+			}
+			dumpKeyPressed = dumpKey;
+		}
 
-	while (!glfwWindowShouldClose(window)) {
-		glfwPollEvents();
+		{
+			// これから再利用するフレームのfenceだけを待つ
+			CpuProfiler::ScopedTimer timer(cpuProfiler, FramePhase::WaitFence);
+			device->waitForFences({ inFlightFences[currentFrame].get() }, VK_TRUE, UINT64_MAX);
+		}
+
+		// 完了した転送のステージング領域と、このフレームが待った転送のセマフォを回収する
+		uploadContext.collect();
+		uploadContext.releaseFrame(currentFrame);
+		// GPUが読み終わったこのフレームの使い捨て領域を空にする
+		frameAllocator.beginFrame(currentFrame);
 
-		sceneData.rectCenter = Vec2{ 0.3f * cosf(time), 0.3f * sinf(time) };
-		time += 0.001;
+		if (config.headless)
+		{
+			// オフスクリーンのイメージはフレームごとに1枚なので取得を待つ必要はない
+			imageIndex = currentFrame;
+		}
+		else
+		{
+			CpuProfiler::ScopedTimer timer(cpuProfiler, FramePhase::Acquire);
+			vk::ResultValue<uint32_t> acquireImgResult(vk::Result::eErrorOutOfDateKHR, 0);
+			try
+			{
+				acquireImgResult = device->acquireNextImageKHR(swapchain.get(), 1'000'000'000, swapchainImgSemaphores[currentFrame].get());
+			}
+			catch (const vk::OutOfDateKHRError&)
+			{
+				// イメージを取得できていないのでセマフォもシグナルされない。作り直してやり直す
+				fixSwapchain();
+				continue;
+			}
 
-		void* data = &sceneData;
-		size_t size = sizeof(SceneData);
+			// eSuboptimalKHRでもイメージとセマフォは取得済みなので、このフレームは描画して提示後に作り直す
+			if (acquireImgResult.result == vk::Result::eSuboptimalKHR)
+			{
+				framebufferResized = true;
+			}
+			else if (acquireImgResult.result != vk::Result::eSuccess) {
+				std::cerr << "次フレームの取得に失敗しました。"<< std::endl;
+				return;
+			}
 
-		std::memcpy(pUniformBufMem, data, size);
+			imageIndex = acquireImgResult.value;
+		}
 
-		vk::MappedMemoryRange flushMemoryRange;
-		flushMemoryRange.memory = uniformBufMem.get();
-		flushMemoryRange.offset = 0;
-		flushMemoryRange.size = size;
+		device->resetFences({ inFlightFences[currentFrame].get() }); //fenceを非シグナル状態にする
 
-		device->flushMappedMemoryRanges({ flushMemoryRange });
+		{
+			CpuProfiler::ScopedTimer timer(cpuProfiler, FramePhase::UniformUpdate);
 
-		device->waitForFences({ swapchainImgFence.get() }, VK_TRUE, UINT64_MAX); //renderfenceVOiԂɂȂ܂ő҂
+			// 読み戻すときは最後のフレームを前のフレームと同じ入力で描き、結果が一致するか確かめる
+			if (!isRepeatedReadbackFrame())
+			{
+				sceneData.rectCenter = Vec2{ 0.3f * cosf(time), 0.3f * sinf(time) };
+				time += 0.001;
+				sceneData.time = time;
+			}
 
-		vk::ResultValue acquireImgResult = device->acquireNextImageKHR(swapchain.get(), 1'000'000'000, swapchainImgSemaphore.get());
+			// GPUへはrender()でプッシュ定数かフレームアロケータのuniformとして渡す
+			bytesUploaded += sizeof(SceneData);
+		}
 
-		if (acquireImgResult.result == vk::Result::eSuboptimalKHR || acquireImgResult.result == vk::Result::eErrorOutOfDateKHR)
 		{
-			cout << "Xbv`F[č쐬܂";
-			fixSwapchain();
-			continue;
+			CpuProfiler::ScopedTimer timer(cpuProfiler, FramePhase::Render);
+			render();
 		}
 
-		if (acquireImgResult.result != vk::Result::eSuccess) {
-			std::cerr << "t[̎擾Ɏs܂B"<< std::endl;
-			return;
+		{
+			CpuProfiler::ScopedTimer timer(cpuProfiler, FramePhase::Present);
+			present();
 		}
 
-		device->resetFences({ swapchainImgFence.get() }); //fenceVOiԂɂ
+		renderedFrameCount++;
+		currentFrame = (currentFrame + 1) % config.framesInFlight;
+	}
+
+	device->waitIdle();
 
-		imageIndex = acquireImgResult.value;
+	// 実行中に作ったパイプラインも含めて次回の起動に使う
+	pipelineManager.waitIdle();
+	pipelineCache.save();
 
-		render();
+	// キャッシュが効いていればここが短くなる
+	cout << "パイプライン作成: " << pipelineManager.getTotalCompileMs() << " ms"
+		<< (pipelineCache.isWarm() ? "（キャッシュあり）" : "（キャッシュなし）") << endl;
 
-		present();
+	elapsedSeconds = chrono::duration<double>(chrono::steady_clock::now() - loopStart).count();
+
+	if (config.headless && config.readback)
+	{
+		checkReadback();
+		if (config.readbackFile)
+		{
+			saveReadback(config.readbackFile);
+		}
 	}
 
-	device->unmapMemory(uniformBufMem.get());
+	for (const auto& scope : gpuProfiler.getStats())
+	{
+		cout << "GPU " << scope.name << ": " << scope.averageMs << " ms" << endl;
+	}
 
-	graphicsQueue.waitIdle();
-	glfwTerminate();
+	if (config.profileFile)
+	{
+		dumpCpuProfile();
+	}
+
+	if (!config.headless)
+	{
+		glfwTerminate();
+	}
+}
+
+vector<GpuProfiler::ScopeStats> Vulkan::getGpuStats() const
+{
+	return gpuProfiler.getStats();
+}
+
+CpuProfiler::PhaseStats Vulkan::getCpuStats(FramePhase phase) const
+{
+	return cpuProfiler.getStats(phase);
+}
+
+FrameStats Vulkan::getFrameStats() const
+{
+	FrameStats stats;
+	stats.frameCount = renderedFrameCount;
+	stats.elapsedSeconds = elapsedSeconds;
+	stats.framesPerSecond = elapsedSeconds > 0.0 ? double(renderedFrameCount) / elapsedSeconds : 0.0;
+	stats.cpuMsPerFrame = cpuProfiler.getStats(FramePhase::Frame).averageMs - cpuProfiler.getStats(FramePhase::WaitFence).averageMs;
+	stats.gpuMsPerFrame = gpuProfiler.getScopeMs("renderpass");
+	stats.bytesUploaded = bytesUploaded;
+	stats.uploadMs = uploadMs;
+	stats.pipelineCreateMs = pipelineManager.getTotalCompileMs();
+	stats.pipelineCacheWarm = pipelineCache.isWarm();
+	stats.readbackMismatch = readbackMismatch;
+	return stats;
+}
+
+void Vulkan::dumpCpuProfile()
+{
+	if (config.profileFile)
+	{
+		cpuProfiler.dump(config.profileFile);
+	}
+	else
+	{
+		cpuProfiler.writeCsv(cout);
+	}
+}
+
+bool Vulkan::shouldClose()
+{
+	if (config.frameCount != 0 && renderedFrameCount >= config.frameCount)
+	{
+		return true;
+	}
+	return !config.headless && glfwWindowShouldClose(window);
 }
 
 void Vulkan::init()
 {
-	if (!glfwInit())
+	if (!config.headless)
 	{
-		throw "glfwInit is failed";
+		if (!glfwInit())
+		{
+			throw "glfwInit is failed";
+		}
 	}
 	createInstance();
-	initWindow();
-	createSurface();
+	if (!config.headless)
+	{
+		initWindow();
+		createSurface();
+	}
 	selectPhysicalDevice();
+	selectVertexFormat();
 	createDevice();
 	createDescriptorSet();
-	createSwapchain();
+	if (config.headless)
+	{
+		createOffscreenTargets();
+	}
+	else
+	{
+		createSwapchain();
+	}
 	createRenderPass();
 	createShaders();
 	createPipeline();
 	createImageView();
 	createFramebuffer();
 	createCommandBuffer();
-	createVertexBuffer(triangle.vert.data(), sizeof(Vertex) * triangle.vert.size());
-	createIndexBuffer(triangle.indices.data(), sizeof(uint32_t) * triangle.indices.size());
+	if (meshes.empty() && packMeshCount == 0)
+	{
+		addMesh(Mesh{ triangle.vert, triangle.indices });
+	}
+	auto uploadStart = chrono::steady_clock::now();
+	uploadMeshes();
+	// 全メッシュの転送を1回で提出する。描画とは同じキューのバリアで順序付けされるので待たない
+	uploadContext.submit();
+	uploadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - uploadStart).count();
 	createFence();
 	createSemaphore();
+	if (config.headless && config.readback)
+	{
+		createReadbackBuffers();
+	}
+	if (config.headless)
+	{
+		// ベンチマークと読み戻しは最初のフレームから全部描かれている必要がある
+		pipelineManager.waitIdle();
+	}
 }
 
 void Vulkan::initWindow()
@@ -93,14 +288,49 @@ void Vulkan::initWindow()
 		std::cout << err << std::endl;
 		glfwTerminate();
 	}
+
+	// 大きさが変わってもeSuboptimalKHRを返さないプラットフォームがあるので自分でも検知する
+	glfwSetWindowUserPointer(window, this);
+	glfwSetFramebufferSizeCallback(window, [](GLFWwindow* window, int, int) {
+		static_cast<Vulkan*>(glfwGetWindowUserPointer(window))->framebufferResized = true;
+	});
 }
 
 void Vulkan::createInstance()
 {
-	uint32_t requiredExtensionsCount;
-	const char** requiredExtensions = glfwGetRequiredInstanceExtensions(&requiredExtensionsCount);
+	// ヘッドレス時はサーフェス用の拡張機能が不要
+	uint32_t requiredExtensionsCount = 0;
+	const char** requiredExtensions = nullptr;
+	if (!config.headless)
+	{
+		requiredExtensions = glfwGetRequiredInstanceExtensions(&requiredExtensionsCount);
+	}
+
+	// CIなど検証レイヤーが入っていない環境では有効にしない
+	vector<vk::LayerProperties> availableLayers = vk::enumerateInstanceLayerProperties();
+	vector<const char*> enabledLayers;
+	for (const char* layer : validationLayers)
+	{
+		for (const auto& prop : availableLayers)
+		{
+			if (string_view(prop.layerName.data()) == layer)
+			{
+				enabledLayers.push_back(layer);
+				break;
+			}
+		}
+	}
+	validationLayers = enabledLayers;
+
+	// drawIndexedIndirectCountなど1.2の機能を使うため、ローダーが対応していれば1.2を要求する
+	instanceApiVersion = std::min(vk::enumerateInstanceVersion(), uint32_t(VK_API_VERSION_1_2));
+
+	vk::ApplicationInfo appInfo;
+	appInfo.pApplicationName = "Vulkan";
+	appInfo.apiVersion = instanceApiVersion;
 
 	vk::InstanceCreateInfo instanceCI;
+	instanceCI.pApplicationInfo = &appInfo;
 	instanceCI.enabledExtensionCount = requiredExtensionsCount;
 	instanceCI.ppEnabledExtensionNames = requiredExtensions;
 	instanceCI.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -129,9 +359,34 @@ void Vulkan::selectPhysicalDevice()
 	{
 		vector<vk::QueueFamilyProperties>props = pd.getQueueFamilyProperties();
 		optional<uint32_t> thisGraphicsQueueIndex;
+
+		if (config.headless)
+		{
+			// プレゼンテーションをしないのでグラフィックス機能だけあればよい
+			for (uint32_t i = 0; i < props.size(); i++)
+			{
+				if (props[i].queueFlags & vk::QueueFlagBits::eGraphics)
+				{
+					thisGraphicsQueueIndex = i;
+					break;
+				}
+			}
+
+			if (thisGraphicsQueueIndex.has_value())
+			{
+				physicalDevice = pd;
+				graphicsQueueFamIndex = thisGraphicsQueueIndex.value();
+				transferQueueFamIndex = findTransferQueueFamily(props);
+				physDevProps = physicalDevice.getProperties();
+				physDevMemProps = physicalDevice.getMemoryProperties();
+				return;
+			}
+			continue;
+		}
+
 		for (uint32_t i = 0; i < props.size(); i++)
 		{
-			// OtBbNX@\ɉăT[tFXւ̃v[e[VT|[gĂL[I
+			// グラフィックス機能に加えてサーフェスへのプレゼンテーションもサポートしているキューを厳選
 			if (props[i].queueFlags & vk::QueueFlagBits::eGraphics && pd.getSurfaceSupportKHR(i, surface.get()) )
 			{
 				thisGraphicsQueueIndex = i;
@@ -157,6 +412,8 @@ void Vulkan::selectPhysicalDevice()
 		{
 			physicalDevice = pd;
 			graphicsQueueFamIndex = thisGraphicsQueueIndex.value();
+			transferQueueFamIndex = findTransferQueueFamily(props);
+			physDevProps = physicalDevice.getProperties();
 			physDevMemProps = physicalDevice.getMemoryProperties();
 			return;
 		}
@@ -164,28 +421,126 @@ void Vulkan::selectPhysicalDevice()
 	throw runtime_error("failed to find a asuitable GPU!");
 }
 
+uint32_t Vulkan::findTransferQueueFamily(const vector<vk::QueueFamilyProperties>& props) const
+{
+	if (!config.asyncTransfer)
+	{
+		return graphicsQueueFamIndex;
+	}
+
+	// グラフィックスもコンピュートも持たないファミリーはDMAエンジンに対応していることが多い
+	for (uint32_t i = 0; i < props.size(); i++)
+	{
+		vk::QueueFlags flags = props[i].queueFlags;
+		if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+		{
+			return i;
+		}
+	}
+
+	// 無ければグラフィックスと別のファミリーで転送できるもの
+	for (uint32_t i = 0; i < props.size(); i++)
+	{
+		vk::QueueFlags flags = props[i].queueFlags;
+		if (i != graphicsQueueFamIndex && (flags & vk::QueueFlagBits::eTransfer) && !(flags & vk::QueueFlagBits::eGraphics))
+		{
+			return i;
+		}
+	}
+
+	return graphicsQueueFamIndex;
+}
+
+void Vulkan::selectVertexFormat()
+{
+	vertexLayout = getVertexLayout(config.vertexFormat);
+
+	// 頂点バッファとして読めない形式なら元の形式に戻す
+	for (uint32_t i = 0; i < vertexLayout.inputState.vertexAttributeDescriptionCount; i++)
+	{
+		vk::Format format = vertexLayout.inputState.pVertexAttributeDescriptions[i].format;
+		if (!(physicalDevice.getFormatProperties(format).bufferFeatures & vk::FormatFeatureFlagBits::eVertexBuffer))
+		{
+			std::cerr << vertexFormatName(config.vertexFormat) << "の頂点形式に対応していないのでfloat32を使います。" << std::endl;
+			config.vertexFormat = VertexFormat::Float32;
+			vertexLayout = getVertexLayout(config.vertexFormat);
+			return;
+		}
+	}
+}
+
 void Vulkan::createDevice()
 {
 
-	auto requireExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	vector<const char*> requireExtensions;
+	if (!config.headless)
+	{
+		requireExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
 	float priorities = 1.0f;
-	// gpL[w肷B
-	vk::DeviceQueueCreateInfo deviceQueueCIs[1];
+	// 使用するキューを指定する。
+	vk::DeviceQueueCreateInfo deviceQueueCIs[2];
 	deviceQueueCIs[0].queueFamilyIndex = graphicsQueueFamIndex;
 	deviceQueueCIs[0].queueCount = 1;
 	deviceQueueCIs[0].pQueuePriorities = &priorities;
+	deviceQueueCIs[1].queueFamilyIndex = transferQueueFamIndex;
+	deviceQueueCIs[1].queueCount = 1;
+	deviceQueueCIs[1].pQueuePriorities = &priorities;
+
+	// 間接描画のfirstInstanceでインスタンスを指すので、drawIndirectFirstInstanceがなければ直接描画する
+	vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice.getFeatures();
+	vk::PhysicalDeviceFeatures enabledFeatures;
+	useIndirectDraws = config.indirectDraws && supportedFeatures.drawIndirectFirstInstance;
+	useMultiDrawIndirect = useIndirectDraws && supportedFeatures.multiDrawIndirect;
+	enabledFeatures.drawIndirectFirstInstance = useIndirectDraws;
+	enabledFeatures.multiDrawIndirect = useMultiDrawIndirect;
+
+	// GPUカリングは描画数をバッファから読むdrawIndexedIndirectCount（1.2）が必要
+	bool supportsVulkan12 = instanceApiVersion >= VK_API_VERSION_1_2 && physDevProps.apiVersion >= VK_API_VERSION_1_2;
+	bool supportsDrawIndirectCount = false;
+	if (supportsVulkan12)
+	{
+		auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+		supportsDrawIndirectCount = features.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount;
+	}
+	useGpuCulling = config.gpuCulling && useMultiDrawIndirect && supportsDrawIndirectCount;
+
+	vk::PhysicalDeviceVulkan12Features enabledFeatures12;
+	enabledFeatures12.drawIndirectCount = useGpuCulling;
+	vk::PhysicalDeviceFeatures2 enabledFeatures2;
+	enabledFeatures2.features = enabledFeatures;
+	enabledFeatures2.pNext = &enabledFeatures12;
 
 	vk::DeviceCreateInfo deviceCI;
+	if (supportsVulkan12)
+	{
+		deviceCI.pNext = &enabledFeatures2;
+	}
+	else
+	{
+		deviceCI.pEnabledFeatures = &enabledFeatures;
+	}
 	deviceCI.pQueueCreateInfos = deviceQueueCIs;
-	deviceCI.queueCreateInfoCount = 1;
+	deviceCI.queueCreateInfoCount = transferQueueFamIndex != graphicsQueueFamIndex ? 2 : 1;
 	deviceCI.enabledExtensionCount = static_cast<uint32_t>(requireExtensions.size());
-	deviceCI.ppEnabledExtensionNames = requireExtensions.begin();
+	deviceCI.ppEnabledExtensionNames = requireExtensions.data();
 	deviceCI.enabledLayerCount = uint32_t(validationLayers.size());
 	deviceCI.ppEnabledLayerNames = validationLayers.data();
 
 	device = physicalDevice.createDeviceUnique(deviceCI);
 
 	graphicsQueue = device->getQueue(graphicsQueueFamIndex, 0);
+	transferQueue = device->getQueue(transferQueueFamIndex, 0);
+
+	allocator.init(physicalDevice, device.get());
+
+	stagingRing.init(device.get(), allocator, config.stagingBufferSize);
+	uploadContext.init(device.get(), transferQueue, transferQueueFamIndex, graphicsQueueFamIndex, config.framesInFlight, stagingRing);
+
+	gpuProfiler.init(physicalDevice, device.get(), graphicsQueueFamIndex, config.framesInFlight);
+
+	pipelineCache.init(physicalDevice, device.get(), config.pipelineCacheFile);
+	pipelineManager.init(pipelineCache.get());
 }
 
 void Vulkan::createSwapchain()
@@ -202,30 +557,163 @@ void Vulkan::createSwapchain()
 	swapchainCreateInfo.minImageCount = surfaceCapabilities.minImageCount + 1;
 	swapchainCreateInfo.imageFormat = swapchainFormat.format;
 	swapchainCreateInfo.imageColorSpace = swapchainFormat.colorSpace;
-	swapchainCreateInfo.imageExtent = surfaceCapabilities.currentExtent;
+	swapchainCreateInfo.imageExtent = chooseSwapchainExtent();
 	swapchainCreateInfo.imageArrayLayers = 1;
 	swapchainCreateInfo.imageUsage = vk::ImageUsageFlagBits::eColorAttachment;
 	swapchainCreateInfo.imageSharingMode = vk::SharingMode::eExclusive;
 	swapchainCreateInfo.preTransform = surfaceCapabilities.currentTransform;
 	swapchainCreateInfo.presentMode = swapchainPresentMode;
 	swapchainCreateInfo.clipped = VK_TRUE;
+	// 作り直すときは古いスワップチェーンを渡し、提示待ちのイメージを引き継がせる
+	swapchainCreateInfo.oldSwapchain = swapchain.get();
+
+	vk::UniqueSwapchainKHR newSwapchain = device->createSwapchainKHRUnique(swapchainCreateInfo);
+	retiredSwapchain = std::move(swapchain);
+	swapchain = std::move(newSwapchain);
+
+	swapchainExtent = swapchainCreateInfo.imageExtent;
+}
+
+vk::Extent2D Vulkan::chooseSwapchainExtent() const
+{
+	// currentExtentが決まっていなければウィンドウのフレームバッファの大きさに合わせる
+	if (surfaceCapabilities.currentExtent.width != UINT32_MAX)
+	{
+		return surfaceCapabilities.currentExtent;
+	}
+
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	vk::Extent2D extent;
+	extent.width = std::clamp(static_cast<uint32_t>(width), surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
+	extent.height = std::clamp(static_cast<uint32_t>(height), surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+	return extent;
+}
+
+void Vulkan::createOffscreenTargets()
+{
+	// スワップチェーンの代わりにデバイスローカルのカラーイメージをフレーム数だけ作る
+	swapchainFormat.format = vk::Format::eR8G8B8A8Unorm;
+	swapchainFormat.colorSpace = vk::ColorSpaceKHR::eSrgbNonlinear;
+	swapchainExtent = vk::Extent2D{ screenWidth, screenHeight };
+
+	vk::ImageCreateInfo imageCI;
+	imageCI.imageType = vk::ImageType::e2D;
+	imageCI.format = swapchainFormat.format;
+	imageCI.extent = vk::Extent3D{ swapchainExtent.width, swapchainExtent.height, 1 };
+	imageCI.mipLevels = 1;
+	imageCI.arrayLayers = 1;
+	imageCI.samples = vk::SampleCountFlagBits::e1;
+	imageCI.tiling = vk::ImageTiling::eOptimal;
+	imageCI.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+	imageCI.sharingMode = vk::SharingMode::eExclusive;
+	imageCI.initialLayout = vk::ImageLayout::eUndefined;
+
+	offscreenImages.resize(config.framesInFlight);
+	offscreenImgMemories.resize(config.framesInFlight);
+	swapchainImages.resize(config.framesInFlight);
+	for (uint32_t i = 0; i < config.framesInFlight; i++)
+	{
+		offscreenImages[i] = device->createImageUnique(imageCI);
+		offscreenImgMemories[i] = getSuitableDevMem(offscreenImages[i].get(), { vk::MemoryPropertyFlagBits::eDeviceLocal, {}, vk::MemoryPropertyFlagBits::eHostVisible });
+		device->bindImageMemory(offscreenImages[i].get(), offscreenImgMemories[i]->memory, offscreenImgMemories[i]->offset);
+		swapchainImages[i] = offscreenImages[i].get();
+	}
+}
+
+void Vulkan::createReadbackBuffers()
+{
+	vk::BufferCreateInfo bufferCI;
+	bufferCI.size = vk::DeviceSize(swapchainExtent.width) * swapchainExtent.height * 4;
+	bufferCI.usage = vk::BufferUsageFlagBits::eTransferDst;
+	bufferCI.sharingMode = vk::SharingMode::eExclusive;
+
+	readbackBuffers.resize(config.framesInFlight);
+	readbackBufMemories.resize(config.framesInFlight);
+	for (uint32_t i = 0; i < config.framesInFlight; i++)
+	{
+		readbackBuffers[i] = device->createBufferUnique(bufferCI);
+		// CPUが読むのでキャッシュされるメモリを優先する
+		readbackBufMemories[i] = getSuitableDevMem(readbackBuffers[i].get(),
+			{ vk::MemoryPropertyFlagBits::eHostVisible, vk::MemoryPropertyFlagBits::eHostCached | vk::MemoryPropertyFlagBits::eHostCoherent, {} });
+		device->bindBufferMemory(readbackBuffers[i].get(), readbackBufMemories[i]->memory, readbackBufMemories[i]->offset);
+	}
+}
+
+bool Vulkan::isRepeatedReadbackFrame() const
+{
+	// 2つの読み戻しバッファに残るよう、フレームを2つ以上同時に処理しているときだけ
+	return config.headless && config.readback && config.framesInFlight >= 2 &&
+		config.frameCount >= 2 && renderedFrameCount + 1 == config.frameCount;
+}
+
+void Vulkan::checkReadback()
+{
+	if (config.framesInFlight < 2 || config.frameCount < 2 || renderedFrameCount != config.frameCount)
+	{
+		return;
+	}
+
+	// 最後の2フレームは同じ入力なので、カリングや描画の順番が変わらなければ同じ画像になる
+	uint32_t lastFrame = (currentFrame + config.framesInFlight - 1) % config.framesInFlight;
+	uint32_t previousFrame = (currentFrame + config.framesInFlight - 2) % config.framesInFlight;
+	allocator.invalidate(readbackBufMemories[lastFrame].get());
+	allocator.invalidate(readbackBufMemories[previousFrame].get());
+
+	size_t size = size_t(swapchainExtent.width) * swapchainExtent.height * 4;
+	readbackMismatch = memcmp(readbackBufMemories[lastFrame]->mapped, readbackBufMemories[previousFrame]->mapped, size) != 0;
+	if (readbackMismatch)
+	{
+		std::cerr << "読み戻し: 同じ入力で描いた最後の2フレームが一致しません。" << std::endl;
+	}
+	else
+	{
+		cout << "読み戻し: 最後の2フレームが一致しました。" << endl;
+	}
+}
+
+void Vulkan::saveReadback(const char* fileName)
+{
+	if (renderedFrameCount == 0)
+	{
+		return;
+	}
+
+	// 最後に描画したフレームの読み戻し結果
+	uint32_t lastFrame = (currentFrame + config.framesInFlight - 1) % config.framesInFlight;
+
+	allocator.invalidate(readbackBufMemories[lastFrame].get());
+
+	ofstream ofs(fileName, ios::binary);
+	if (!ofs.is_open())
+	{
+		std::cerr << "読み戻し結果を書き出せません: " << fileName << std::endl;
+		return;
+	}
+
+	ofs << "P6\n" << swapchainExtent.width << " " << swapchainExtent.height << "\n255\n";
 
-	swapchain = device->createSwapchainKHRUnique(swapchainCreateInfo);
+	const uint8_t* pixels = static_cast<const uint8_t*>(readbackBufMemories[lastFrame]->mapped);
+	size_t pixelCount = size_t(swapchainExtent.width) * swapchainExtent.height;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		ofs.write(reinterpret_cast<const char*>(pixels + i * 4), 3);
+	}
 }
 
 void Vulkan::createCommandBuffer()
 {
-	// R}hv[̍쐬
+	// コマンドプールの作成
 	vk::CommandPoolCreateInfo cmdPoolCI;
 	cmdPoolCI.queueFamilyIndex = graphicsQueueFamIndex;
 	cmdPoolCI.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
 
 	commandPool = device->createCommandPoolUnique(cmdPoolCI);
 
-	// R}hobt@̍쐬
+	// コマンドバッファの作成
 	vk::CommandBufferAllocateInfo amdBufferAllocInfo;
 	amdBufferAllocInfo.commandPool = commandPool.get();
-	amdBufferAllocInfo.commandBufferCount = 1;
+	amdBufferAllocInfo.commandBufferCount = config.framesInFlight;
 	amdBufferAllocInfo.level = vk::CommandBufferLevel::ePrimary;
 
 	commandBuffers = device->allocateCommandBuffersUnique(amdBufferAllocInfo);
@@ -241,7 +729,18 @@ void Vulkan::createRenderPass()
 	attachments[0].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
 	attachments[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
 	attachments[0].initialLayout = vk::ImageLayout::eUndefined;
-	attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+	if (!config.headless)
+	{
+		attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+	}
+	else if (config.readback)
+	{
+		attachments[0].finalLayout = vk::ImageLayout::eTransferSrcOptimal;
+	}
+	else
+	{
+		attachments[0].finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
+	}
 
 	vk::AttachmentReference subpass0_attachmentRefs[1];
 	subpass0_attachmentRefs[0].attachment = 0;
@@ -257,123 +756,124 @@ void Vulkan::createRenderPass()
 	renderPassCI.pAttachments = attachments;
 	renderPassCI.subpassCount = 1;
 	renderPassCI.pSubpasses = subpasses;
-	renderPassCI.dependencyCount = 0;
-	renderPassCI.pDependencies = nullptr;
+	// 読み戻すときは、レンダーパスの後のコピーがカラーの書き込みを待つようにする
+	vk::SubpassDependency dependencies[1];
+	dependencies[0].srcSubpass = 0;
+	dependencies[0].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+	dependencies[0].srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+	dependencies[0].dstStageMask = vk::PipelineStageFlagBits::eTransfer;
+	dependencies[0].dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
+	bool readback = config.headless && config.readback;
+	renderPassCI.dependencyCount = readback ? 1 : 0;
+	renderPassCI.pDependencies = readback ? dependencies : nullptr;
 
 	renderpass = device->createRenderPassUnique(renderPassCI);
 }
 
 void Vulkan::createPipeline()
 {
-	vk::Viewport viewports[1];
-	viewports[0].x = 0.0;
-	viewports[0].y = 0.0;
-	viewports[0].minDepth = 0.0;
-	viewports[0].maxDepth = 1.0;
-	viewports[0].width = static_cast<float>(screenWidth);
-	viewports[0].height = static_cast<float>(screenHeight);
-
-	vk::Rect2D scissors[1];
-	scissors[0].offset = vk::Offset2D({ 0, 0 });
-	scissors[0].extent = vk::Extent2D({screenWidth, screenHeight});
-
-	vk::PipelineViewportStateCreateInfo viewportState;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = viewports;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = scissors;
-
-	// fXNvV
-	//binding
-	vk::VertexInputBindingDescription vertInputBindingDescription[1];
-	vertInputBindingDescription[0].binding = 0;
-	vertInputBindingDescription[0].stride = sizeof(Vertex);
-	vertInputBindingDescription[0].inputRate = vk::VertexInputRate::eVertex;
-
-	// attribute
-	vk::VertexInputAttributeDescription vertInputAttribDescription[3];
-	vertInputAttribDescription[0].binding = 0;
-	vertInputAttribDescription[0].location = 0;
-	vertInputAttribDescription[0].format = vk::Format::eR32G32Sfloat;
-	vertInputAttribDescription[0].offset = offsetof(Vertex, pos);
-	vertInputAttribDescription[1].binding = 0;
-	vertInputAttribDescription[1].location = 1;
-	vertInputAttribDescription[1].format = vk::Format::eR32G32B32Sfloat;
-	vertInputAttribDescription[1].offset = offsetof(Vertex, color);
-
-	vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = vertInputBindingDescription;
-	vertexInputInfo.vertexAttributeDescriptionCount = 2;
-	vertexInputInfo.pVertexAttributeDescriptions = vertInputAttribDescription;
-
-	vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
-	inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
-	inputAssembly.primitiveRestartEnable = false;
-
-	vk::PipelineRasterizationStateCreateInfo rasterizer;
-	rasterizer.depthClampEnable = false;
-	rasterizer.rasterizerDiscardEnable = false;
-	rasterizer.polygonMode = vk::PolygonMode::eFill;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = vk::CullModeFlagBits::eBack;
-	rasterizer.frontFace = vk::FrontFace::eClockwise;
-	rasterizer.depthBiasEnable = false;
-
-	vk::PipelineMultisampleStateCreateInfo multisample;
-	multisample.sampleShadingEnable = false;
-	multisample.rasterizationSamples = vk::SampleCountFlagBits::e1;
-
-	vk::PipelineColorBlendAttachmentState blendattachment[1];
-	blendattachment[0].colorWriteMask =
-		vk::ColorComponentFlagBits::eA |
-		vk::ColorComponentFlagBits::eR |
-		vk::ColorComponentFlagBits::eG |
-		vk::ColorComponentFlagBits::eB;
-	blendattachment[0].blendEnable = false;
-
-	vk::PipelineColorBlendStateCreateInfo blend;
-	blend.logicOpEnable = false;
-	blend.attachmentCount = 1;
-	blend.pAttachments = blendattachment;
-
-	// descriptorSetLayout
-
-	auto pipelineDescriptorSetLayouts = { descriptorSetLayout.get() };
-
-	vk::PipelineLayoutCreateInfo layoutCreateInfo;
-	layoutCreateInfo.setLayoutCount = pipelineDescriptorSetLayouts.size();
-	layoutCreateInfo.pSetLayouts = pipelineDescriptorSetLayouts.begin();
-
-	pipelineLayout = device->createPipelineLayoutUnique(layoutCreateInfo);
-
-	vk::PipelineShaderStageCreateInfo shaderStage[2];
-	shaderStage[0].stage = vk::ShaderStageFlagBits::eVertex;
-	shaderStage[0].module = vertShader.get();
-	shaderStage[0].pName = "main";
-	shaderStage[1].stage = vk::ShaderStageFlagBits::eFragment;
-	shaderStage[1].module = fragShader.get();
-	shaderStage[1].pName = "main";
-
-	vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
-	pipelineCreateInfo.pViewportState = &viewportState;
-	pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
-	pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
-	pipelineCreateInfo.pRasterizationState = &rasterizer;
-	pipelineCreateInfo.pMultisampleState = &multisample;
-	pipelineCreateInfo.pColorBlendState = &blend;
-	pipelineCreateInfo.layout = pipelineLayout.get();
-	pipelineCreateInfo.stageCount = 2;
-	pipelineCreateInfo.pStages = shaderStage;
-	pipelineCreateInfo.renderPass = renderpass.get();
-	pipelineCreateInfo.subpass = 0;
-
-	pipeline = device->createGraphicsPipelineUnique(nullptr, pipelineCreateInfo).value;
+	// レイアウトは描画の記録にも使うのでこのスレッドで作っておく
+	if (!pipelineLayout)
+	{
+		auto pipelineDescriptorSetLayouts = { descriptorSetLayout };
+
+		// プッシュ定数で渡すときはその範囲を加える。セットは使わなくても同じレイアウトのままにしておく
+		vk::PipelineLayoutCreateInfo layoutCreateInfo;
+		layoutCreateInfo.setLayoutCount = pipelineDescriptorSetLayouts.size();
+		layoutCreateInfo.pSetLayouts = pipelineDescriptorSetLayouts.begin();
+		layoutCreateInfo.pushConstantRangeCount = drawConstants.getPushConstantRangeCount();
+		layoutCreateInfo.pPushConstantRanges = drawConstants.getPushConstantRange();
+
+		pipelineLayout = device->createPipelineLayoutUnique(layoutCreateInfo);
+	}
+
+	// ワーカースレッドで作るので、使うハンドルと頂点入力の記述は値で渡す
+	vk::Device dev = device.get();
+	vk::RenderPass renderPass = renderpass.get();
+	vk::PipelineLayout layout = pipelineLayout.get();
+	vk::ShaderModule vert = vertShader.get();
+	vk::ShaderModule frag = fragShader.get();
+	VertexLayout vertexInput = vertexLayout;
+
+	meshPipeline = pipelineManager.request("mesh", [=](vk::PipelineCache cache) {
+		// ビューポートとシザーは動的ステートにして、ウィンドウの大きさが変わってもパイプラインを作り直さない
+		vk::PipelineViewportStateCreateInfo viewportState;
+		viewportState.viewportCount = 1;
+		viewportState.scissorCount = 1;
+
+		vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+		vk::PipelineDynamicStateCreateInfo dynamicState;
+		dynamicState.dynamicStateCount = 2;
+		dynamicState.pDynamicStates = dynamicStates;
+
+		// 頂点入力の記述は頂点の構造体からコンパイル時に作ったもの
+		vk::PipelineVertexInputStateCreateInfo vertexInputInfo = vertexInput.inputState;
+
+		vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
+		inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
+		inputAssembly.primitiveRestartEnable = false;
+
+		vk::PipelineRasterizationStateCreateInfo rasterizer;
+		rasterizer.depthClampEnable = false;
+		rasterizer.rasterizerDiscardEnable = false;
+		rasterizer.polygonMode = vk::PolygonMode::eFill;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = vk::CullModeFlagBits::eBack;
+		rasterizer.frontFace = vk::FrontFace::eClockwise;
+		rasterizer.depthBiasEnable = false;
+
+		vk::PipelineMultisampleStateCreateInfo multisample;
+		multisample.sampleShadingEnable = false;
+		multisample.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+		vk::PipelineColorBlendAttachmentState blendattachment[1];
+		blendattachment[0].colorWriteMask =
+			vk::ColorComponentFlagBits::eA |
+			vk::ColorComponentFlagBits::eR |
+			vk::ColorComponentFlagBits::eG |
+			vk::ColorComponentFlagBits::eB;
+		blendattachment[0].blendEnable = false;
+
+		vk::PipelineColorBlendStateCreateInfo blend;
+		blend.logicOpEnable = false;
+		blend.attachmentCount = 1;
+		blend.pAttachments = blendattachment;
+
+		vk::PipelineShaderStageCreateInfo shaderStage[2];
+		shaderStage[0].stage = vk::ShaderStageFlagBits::eVertex;
+		shaderStage[0].module = vert;
+		shaderStage[0].pName = "main";
+		shaderStage[1].stage = vk::ShaderStageFlagBits::eFragment;
+		shaderStage[1].module = frag;
+		shaderStage[1].pName = "main";
+
+		vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+		pipelineCreateInfo.pRasterizationState = &rasterizer;
+		pipelineCreateInfo.pMultisampleState = &multisample;
+		pipelineCreateInfo.pColorBlendState = &blend;
+		pipelineCreateInfo.pDynamicState = &dynamicState;
+		pipelineCreateInfo.layout = layout;
+		pipelineCreateInfo.stageCount = 2;
+		pipelineCreateInfo.pStages = shaderStage;
+		pipelineCreateInfo.renderPass = renderPass;
+		pipelineCreateInfo.subpass = 0;
+
+		return dev.createGraphicsPipelineUnique(cache, pipelineCreateInfo).value;
+	});
 }
 
 void Vulkan::createImageView()
 {
-	swapchainImages = device->getSwapchainImagesKHR(swapchain.get());
+	// ヘッドレス時はcreateOffscreenTargets()で作ったイメージをそのまま使う
+	if (!config.headless)
+	{
+		swapchainImages = device->getSwapchainImagesKHR(swapchain.get());
+	}
 	swapchainImageViews.resize(swapchainImages.size());
 	for (uint32_t i = 0; i < swapchainImages.size(); i++)
 	{
@@ -404,8 +904,8 @@ void Vulkan::createFramebuffer()
 		frameBufferAttachments[0] = swapchainImageViews[i].get();
 
 		vk::FramebufferCreateInfo frameBufCreateInfo;
-		frameBufCreateInfo.width = surfaceCapabilities.currentExtent.width;
-		frameBufCreateInfo.height = surfaceCapabilities.currentExtent.height;
+		frameBufCreateInfo.width = swapchainExtent.width;
+		frameBufCreateInfo.height = swapchainExtent.height;
 		frameBufCreateInfo.layers = 1;
 		frameBufCreateInfo.renderPass = renderpass.get();
 		frameBufCreateInfo.attachmentCount = 1;
@@ -417,9 +917,30 @@ void Vulkan::createFramebuffer()
 
 void Vulkan::render()
 {
-	commandBuffers[0]->reset();
+	vk::CommandBuffer commandBuffer = commandBuffers[currentFrame].get();
+
+	commandBuffer.reset();
 	vk::CommandBufferBeginInfo cmdBeginInfo;
-	commandBuffers[0]->begin(cmdBeginInfo);
+	commandBuffer.begin(cmdBeginInfo);
+
+	// 転送キューから届いたバッファの所有権を獲得する
+	vector<vk::Semaphore> renderWaitSemaphores;
+	vector<vk::PipelineStageFlags> renderWaitStages;
+	uploadContext.acquireOwnership(commandBuffer, currentFrame, renderWaitSemaphores, renderWaitStages);
+
+	gpuProfiler.beginFrame(commandBuffer, currentFrame);
+
+	// レンダーパスの外で、見えるインスタンスと描画コマンドを詰める
+	// カリングのパイプラインがまだできていなければ、全部のコマンドをそのまま描く
+	bool culled = false;
+	if (useGpuCulling && gpuCulling.isReady())
+	{
+		GpuProfiler::Scope cullScope(gpuProfiler, commandBuffer, "culling");
+		gpuCulling.record(commandBuffer, sceneData);
+		culled = true;
+	}
+
+	uint32_t renderPassScope = gpuProfiler.beginScope(commandBuffer, "renderpass");
 
 	vk::ClearValue clearVal[1];
 	clearVal[0].color.float32[0] = 0.0f;
@@ -430,50 +951,162 @@ void Vulkan::render()
 	vk::RenderPassBeginInfo renderpassBeginInfo;
 	renderpassBeginInfo.renderPass = renderpass.get();
 	renderpassBeginInfo.framebuffer = swapchainFrameBuffers[imageIndex].get();
-	renderpassBeginInfo.renderArea = vk::Rect2D({ 0,0 }, { screenWidth, screenHeight });
+	renderpassBeginInfo.renderArea = vk::Rect2D({ 0,0 }, swapchainExtent);
 	renderpassBeginInfo.clearValueCount = 1;
 	renderpassBeginInfo.pClearValues = clearVal;
 
-	commandBuffers[0]->beginRenderPass(renderpassBeginInfo, vk::SubpassContents::eInline);
-	commandBuffers[0]->bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.get());
-	commandBuffers[0]->bindVertexBuffers(0, { vertexBuffer.get()}, {0});
-	commandBuffers[0]->bindIndexBuffer(indexBuffer.get(), 0, vk::IndexType::eUint32);
-	commandBuffers[0]->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout.get(), 0, { descriptorSets[0].get()}, {});
+	commandBuffer.beginRenderPass(renderpassBeginInfo, vk::SubpassContents::eInline);
+
+	// パイプラインの作成が終わるまではクリアだけして、コンパイルを待たない
+	vk::Pipeline pipeline = pipelineManager.get(meshPipeline);
+	if (pipeline)
+	{
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+		drawConstants.set(commandBuffer, pipelineLayout.get(), frameAllocator, descriptorSet, 0, sceneData);
+
+		vk::Viewport viewport;
+		viewport.x = 0.0;
+		viewport.y = 0.0;
+		viewport.width = static_cast<float>(swapchainExtent.width);
+		viewport.height = static_cast<float>(swapchainExtent.height);
+		viewport.minDepth = 0.0;
+		viewport.maxDepth = 1.0;
+		commandBuffer.setViewport(0, { viewport });
+		commandBuffer.setScissor(0, { vk::Rect2D({ 0, 0 }, swapchainExtent) });
+
+		// ここでサブパス0番の処理
+		GpuProfiler::Scope drawScope(gpuProfiler, commandBuffer, "meshes");
+		drawMeshes(commandBuffer, culled);
+	}
+
+	commandBuffer.endRenderPass();
 
-	// ŃTupX0Ԃ̏
-	commandBuffers[0]->drawIndexed(triangle.indices.size(), 1, 0, 0, 0); //͒_̌
+	gpuProfiler.endScope(commandBuffer, renderPassScope);
 
-	commandBuffers[0]->endRenderPass();
+	if (config.headless && config.readback)
+	{
+		// 描画結果をこのフレームの読み戻しバッファにコピー
+		vk::BufferImageCopy region;
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = vk::Offset3D{ 0, 0, 0 };
+		region.imageExtent = vk::Extent3D{ swapchainExtent.width, swapchainExtent.height, 1 };
+
+		commandBuffer.copyImageToBuffer(swapchainImages[imageIndex], vk::ImageLayout::eTransferSrcOptimal, readbackBuffers[currentFrame].get(), { region });
+
+		vk::MemoryBarrier hostReadBarrier;
+		hostReadBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		hostReadBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, { hostReadBarrier }, {}, {});
+	}
 
-	commandBuffers[0]->end();
+	commandBuffer.end();
 
-	vk::CommandBuffer submitCmdBuf[1] = { commandBuffers[0].get() };
-	vk::Semaphore renderWaitSemaphores[] = { swapchainImgSemaphore.get() };
-	vk::Semaphore renderSignalSemaphores[] = { imgRenderedSemaphore.get() };
-	vk::PipelineStageFlags renderwaitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+	// コヒーレントなメモリなら何もしない
+	frameAllocator.endFrame();
+
+	vk::CommandBuffer submitCmdBuf[1] = { commandBuffer };
+	vk::Semaphore renderSignalSemaphores[] = { imgRenderedSemaphores[imageIndex].get() };
 
 	vk::SubmitInfo submitInfo;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = renderWaitSemaphores;
-	submitInfo.pWaitDstStageMask = renderwaitStages;
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = renderSignalSemaphores;
+	if (!config.headless)
+	{
+		// ヘッドレス時は取得もプレゼンテーションもしないのでスワップチェーンのセマフォは使わない
+		renderWaitSemaphores.push_back(swapchainImgSemaphores[currentFrame].get());
+		renderWaitStages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = renderSignalSemaphores;
+	}
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(renderWaitSemaphores.size());
+	submitInfo.pWaitSemaphores = renderWaitSemaphores.data();
+	submitInfo.pWaitDstStageMask = renderWaitStages.data();
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = submitCmdBuf;
 
-	graphicsQueue.submit({ submitInfo }, swapchainImgFence.get());
+	// GPUの完了は待たずに次のフレームの記録へ進む
+	graphicsQueue.submit({ submitInfo }, inFlightFences[currentFrame].get());
+}
 
-	graphicsQueue.waitIdle();
+void Vulkan::drawMeshes(vk::CommandBuffer commandBuffer, bool culled)
+{
+	if (culled)
+	{
+		// カリングで詰めたインスタンスとコマンドを、バッチごとにGPUが数えた分だけ描く
+		commandBuffer.bindVertexBuffers(1, { gpuCulling.getVisibleInstanceBuffer() }, { 0 });
+
+		constexpr uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+		for (uint32_t b = 0; b < indirectBatches.size(); b++)
+		{
+			const IndirectDrawBatch& batch = indirectBatches[b];
+			geometryArena.bindVertices(commandBuffer, batch.page);
+			geometryArena.bindIndices(commandBuffer, batch.page, batch.indexType);
+			commandBuffer.drawIndexedIndirectCount(gpuCulling.getCommandBuffer(), vk::DeviceSize(stride) * batch.firstCommand,
+				gpuCulling.getCountBuffer(), sizeof(uint32_t) * b, batch.commandCount, stride);
+		}
+		return;
+	}
+
+	// インスタンスは1つのバッファにまとまっているのでfirstInstanceで指すだけでよい
+	commandBuffer.bindVertexBuffers(1, { instanceBuffer.get() }, { 0 });
+
+	if (useIndirectDraws)
+	{
+		constexpr uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+		// multiDrawIndirectがなければdrawCountは1まで
+		uint32_t maxDrawCount = useMultiDrawIndirect ? std::max(physDevProps.limits.maxDrawIndirectCount, 1u) : 1;
+		for (const IndirectDrawBatch& batch : indirectBatches)
+		{
+			geometryArena.bindVertices(commandBuffer, batch.page);
+			geometryArena.bindIndices(commandBuffer, batch.page, batch.indexType);
+
+			for (uint32_t i = 0; i < batch.commandCount; i += maxDrawCount)
+			{
+				vk::DeviceSize offset = vk::DeviceSize(stride) * (batch.firstCommand + i);
+				commandBuffer.drawIndexedIndirect(indirectBuffer.get(), offset, std::min(maxDrawCount, batch.commandCount - i), stride);
+			}
+		}
+		return;
+	}
+
+	// 共有バッファはページかインデックスの型が変わるときだけバインドし直す
+	uint32_t boundPage = UINT32_MAX;
+	optional<vk::IndexType> boundIndexType;
+	for (const MeshDraw& draw : meshDraws)
+	{
+		const MeshHandle& mesh = draw.mesh;
+		if (mesh.page != boundPage)
+		{
+			geometryArena.bindVertices(commandBuffer, mesh.page);
+			boundIndexType.reset();
+		}
+		if (mesh.page != boundPage || mesh.indexType != boundIndexType)
+		{
+			geometryArena.bindIndices(commandBuffer, mesh.page, mesh.indexType);
+			boundPage = mesh.page;
+			boundIndexType = mesh.indexType;
+		}
+		commandBuffer.drawIndexed(mesh.indexCount, draw.instanceCount, mesh.firstIndex, mesh.vertexOffset, draw.firstInstance);
+	}
 }
 
 void Vulkan::present()
 {
+	if (config.headless)
+	{
+		return;
+	}
+
 	vk::PresentInfoKHR presentInfo;
 
 	auto presentSwapchains = { swapchain.get() };
 	auto imgIndices = { imageIndex };
 
-	vk::Semaphore presentWaitSenaphores[] = { imgRenderedSemaphore.get() };
+	vk::Semaphore presentWaitSenaphores[] = { imgRenderedSemaphores[imageIndex].get() };
 
 	presentInfo.swapchainCount = static_cast<uint32_t>(presentSwapchains.size());
 	presentInfo.pSwapchains = presentSwapchains.begin();
@@ -481,303 +1114,378 @@ void Vulkan::present()
 	presentInfo.waitSemaphoreCount = 1;
 	presentInfo.pWaitSemaphores = presentWaitSenaphores;
 
-	graphicsQueue.presentKHR(presentInfo);
+	vk::Result result;
+	try
+	{
+		result = graphicsQueue.presentKHR(presentInfo);
+	}
+	catch (const vk::OutOfDateKHRError&)
+	{
+		result = vk::Result::eErrorOutOfDateKHR;
+	}
+
+	if (result != vk::Result::eSuccess || framebufferResized)
+	{
+		fixSwapchain();
+	}
 }
 
 void Vulkan::createShaders()
 {
-	vector<char> vertSpv = readFile("shaders/shader.vert.spv");
-	vector<char> fragSpv = readFile("shaders/shader.frag.spv");
-
-	vk::ShaderModuleCreateInfo vertShaderCI;
-	vertShaderCI.codeSize = vertSpv.size();
-	vertShaderCI.pCode = reinterpret_cast<const uint32_t*>(vertSpv.data());
+	// アセットパックに同じ名前のSPIR-Vがあればそれを、なければ実行ファイルに組み込んだものを使う
+	auto createShader = [&](const char* name) {
+		optional<AssetView> asset = assetPack.find(name);
+		if (asset && asset->type == AssetType::Shader)
+		{
+			vk::ShaderModuleCreateInfo shaderCI;
+			shaderCI.codeSize = asset->size;
+			shaderCI.pCode = reinterpret_cast<const uint32_t*>(asset->data); // ブロブは256バイト境界にある
+			return device->createShaderModuleUnique(shaderCI);
+		}
+		return createShaderModule(device.get(), name);
+	};
 
-	vk::ShaderModuleCreateInfo fragShaderCI;
-	fragShaderCI.codeSize = fragSpv.size();
-	fragShaderCI.pCode = reinterpret_cast<const uint32_t*>(fragSpv.data());
+	// SceneDataをプッシュ定数で渡すときは宣言だけが違う変種を使う
+	vertShader = createShader(drawConstants.usesPushConstants() ? "shader.vert.push" : "shader.vert");
+	fragShader = createShader("shader.frag");
 
-	vertShader = device->createShaderModuleUnique(vertShaderCI);
-	fragShader = device->createShaderModuleUnique(fragShaderCI);
-}
-
-vector<char> Vulkan::readFile(const char* fileName)
-{
-	
-	ifstream ifs(fileName, ios::binary);
-	if (!ifs.is_open())
+	if (useGpuCulling)
 	{
-		cout << "file open is failed!";
+		cullShader = createShader("cull.comp");
 	}
-	uintmax_t fileSize = filesystem::file_size(fileName);
-	vector<char> fileData(fileSize);
-
-	ifs.read(fileData.data(), fileSize);
-
-	return fileData;
 }
 
 void Vulkan::createFence()
 {
 	vk::FenceCreateInfo fenceCI;
 	fenceCI.flags = vk::FenceCreateFlagBits::eSignaled;
-	swapchainImgFence = device->createFenceUnique(fenceCI);
+
+	inFlightFences.resize(config.framesInFlight);
+	for (auto& fence : inFlightFences)
+	{
+		fence = device->createFenceUnique(fenceCI);
+	}
 }
 
 void Vulkan::createSemaphore()
 {
 	vk::SemaphoreCreateInfo semaphoreCI{};
 
-	swapchainImgSemaphore = device->createSemaphoreUnique(semaphoreCI);
-	imgRenderedSemaphore = device->createSemaphoreUnique(semaphoreCI);
-}
-
-void Vulkan::fixSwapchain()
-{
-	// swapchain֘ÃIuWFNgj
-	swapchainFrameBuffers.clear();
-	swapchainImageViews.clear();
-	swapchainImages.clear();
-	swapchain.reset();
-
-	createSwapchain();
-	createRenderPass();
-	createPipeline();
-	createImageView();
-	createFramebuffer();
-}
-
-vk::UniqueDeviceMemory Vulkan::getSuitableDevMem(vk::Buffer buffer, vk::MemoryPropertyFlagBits flag)
-{
-	// foCX̍쐬
-
-	vk::MemoryRequirements memReq = device->getBufferMemoryRequirements(buffer);
-
-	vk::MemoryAllocateInfo memAlloc;
-	memAlloc.allocationSize = memReq.size;
-
-	bool suitableMemoryTypeFound = false;
-
-	for (uint32_t i = 0; i < physDevMemProps.memoryTypeCount; i++)
+	// スワップチェーンを作り直したときは足りない分だけ作る。提示が待っているかもしれないセマフォは壊さない
+	swapchainImgSemaphores.resize(config.framesInFlight);
+	for (auto& semaphore : swapchainImgSemaphores)
 	{
-		if (memReq.memoryTypeBits & (1 << i) && (physDevMemProps.memoryTypes[i].propertyFlags & flag))
+		if (!semaphore)
 		{
-			memAlloc.memoryTypeIndex = i;
-			suitableMemoryTypeFound = true;
-			break;
+			semaphore = device->createSemaphoreUnique(semaphoreCI);
 		}
 	}
 
-	if (!suitableMemoryTypeFound) {
-		std::cerr << "K؂ȃ^Cv݂܂B" << std::endl;
+	// presentが待つセマフォはイメージ単位で持つ
+	imgRenderedSemaphores.resize(std::max(imgRenderedSemaphores.size(), swapchainImages.size()));
+	for (auto& semaphore : imgRenderedSemaphores)
+	{
+		if (!semaphore)
+		{
+			semaphore = device->createSemaphoreUnique(semaphoreCI);
+		}
 	}
-
-	vk::UniqueDeviceMemory deviceMemory = device->allocateMemoryUnique(memAlloc);
-
-	return deviceMemory;
 }
 
-void Vulkan::createVertexBuffer(void *data, size_t size)
+void Vulkan::fixSwapchain()
 {
-	// obt@̍쐬
-	vk::BufferCreateInfo BufferCI{};
-	BufferCI.size = size;
-	BufferCI.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer;
-	BufferCI.sharingMode = vk::SharingMode::eExclusive;
-
-	vertexBuffer = device->createBufferUnique(BufferCI);
-
-	// foCX̍쐬
+	framebufferResized = false;
+	if (config.headless)
+	{
+		return; // オフスクリーンのイメージは作り直さない
+	}
 
-	vertDeviceMemory = getSuitableDevMem(vertexBuffer.get(), vk::MemoryPropertyFlagBits::eDeviceLocal);
+	// 最小化中は大きさが0になりスワップチェーンを作れないので、戻るまで待つ
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	while ((width == 0 || height == 0) && !glfwWindowShouldClose(window))
+	{
+		glfwWaitEvents();
+		glfwGetFramebufferSize(window, &width, &height);
+	}
+	if (width == 0 || height == 0)
+	{
+		return; // 最小化したまま閉じられた
+	}
 
-	device->bindBufferMemory(vertexBuffer.get(), vertDeviceMemory.get(), 0);
+	vk::Format oldFormat = swapchainFormat.format;
+	createSwapchain();
 
-	createStagingBuffer(data, size);
+	// 古いイメージを使うコマンドが終わるまで待つ。転送キューは止めない
+	graphicsQueue.waitIdle();
 
-	// R}hobt@̍쐬
-	vk::CommandPoolCreateInfo cmdPoolCI{};
-	cmdPoolCI.queueFamilyIndex = graphicsQueueFamIndex;
-	cmdPoolCI.flags = vk::CommandPoolCreateFlagBits::eTransient;
-	
-	vk::UniqueCommandPool cmdPool = device->createCommandPoolUnique(cmdPoolCI);
+	// 大きさに依存するものだけを作り直す
+	swapchainFrameBuffers.clear();
+	swapchainImageViews.clear();
+	retiredSwapchain.reset();
 
-	vk::CommandBufferAllocateInfo cmdBufAllocInfo;
-	cmdBufAllocInfo.commandPool = cmdPool.get();
-	cmdBufAllocInfo.commandBufferCount = 1;
-	cmdBufAllocInfo.level = vk::CommandBufferLevel::ePrimary;
+	// 形式が変わったときだけはレンダーパスとパイプラインも作り直す
+	if (swapchainFormat.format != oldFormat)
+	{
+		pipelineManager.waitIdle(); // 作成中のパイプラインが古いレンダーパスを参照している
+		createRenderPass();
+		createPipeline();
+	}
+	createImageView();
+	createFramebuffer();
+	createSemaphore();
+}
 
-	vector<vk::UniqueCommandBuffer> tmpCmdBuffers = device->allocateCommandBuffersUnique(cmdBufAllocInfo);
+UniqueAllocation Vulkan::getSuitableDevMem(vk::Buffer buffer, const MemoryUsage& usage)
+{
+	return getSuitableDevMem(device->getBufferMemoryRequirements(buffer), usage, true);
+}
 
-	// Xe[WOobt@foCX[J̃obt@ɃRs[
-	vk::BufferCopy bufferCopy;
-	bufferCopy.srcOffset = 0;
-	bufferCopy.dstOffset = 0;
-	bufferCopy.size = size;
+UniqueAllocation Vulkan::getSuitableDevMem(vk::Image image, const MemoryUsage& usage)
+{
+	return getSuitableDevMem(device->getImageMemoryRequirements(image), usage, false);
+}
 
-	vk::CommandBufferBeginInfo cmdBeginInfo;
-	cmdBeginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+UniqueAllocation Vulkan::getSuitableDevMem(const vk::MemoryRequirements& memReq, const MemoryUsage& usage, bool linear)
+{
+	// デバイスメモリの作成
 
-	tmpCmdBuffers[0]->begin(cmdBeginInfo);
-	tmpCmdBuffers[0]->copyBuffer(stagingBuffer.get(), vertexBuffer.get(), { bufferCopy });
-	tmpCmdBuffers[0]->end();
+	optional<uint32_t> memoryTypeIndex = allocator.findMemoryType(memReq.memoryTypeBits, usage);
 
-	// submit
-	vk::CommandBuffer submitCmdBufs[1] = {tmpCmdBuffers[0].get()};
-	
-	vk::SubmitInfo submitInfo{};
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = submitCmdBufs;
+	if (!memoryTypeIndex.has_value()) {
+		std::cerr << "適切なメモリタイプが存在しません。" << std::endl;
+		throw runtime_error("failed to find a suitable memory type!");
+	}
 
-	graphicsQueue.submit({ submitInfo });
-	graphicsQueue.waitIdle();
+	// 大きなブロックから切り出す
+	return UniqueAllocation(&allocator, allocator.allocate(memReq, memoryTypeIndex.value(), linear));
 }
 
-void Vulkan::createIndexBuffer(void* data, size_t size)
+MemoryUsage Vulkan::geometryMemoryUsage() const
 {
-	createStagingBuffer(data, size);
-
-	vk::BufferCreateInfo bufferCI;
-	bufferCI.size = size;
-	bufferCI.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer;
-	bufferCI.sharingMode = vk::SharingMode::eExclusive;
-
-	indexBuffer = device->createBufferUnique(bufferCI);
-
-	idxDeviceMemory = getSuitableDevMem(indexBuffer.get(), vk::MemoryPropertyFlagBits::eDeviceLocal);
+	// ReBARなどCPUから書けるデバイスローカルのヒープが十分大きければそこに直接置く
+	if (allocator.hasLargeHostVisibleDeviceLocalHeap())
+	{
+		return { vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, {} };
+	}
+	// 小さいBAR領域はuniform用に残しておく
+	return { vk::MemoryPropertyFlagBits::eDeviceLocal, {}, vk::MemoryPropertyFlagBits::eHostVisible };
+}
 
-	device->bindBufferMemory(indexBuffer.get(), idxDeviceMemory.get(), 0);
+void Vulkan::uploadMeshes()
+{
+	geometryArena.init(device.get(), allocator, uploadContext, geometryMemoryUsage(), vertexLayout.stride, config.arenaVertexCount, config.arenaIndexCount);
 
-	// R}hobt@̍쐬
-	vk::CommandPoolCreateInfo cmdPoolCI{};
-	cmdPoolCI.queueFamilyIndex = graphicsQueueFamIndex;
-	cmdPoolCI.flags = vk::CommandPoolCreateFlagBits::eTransient;
+	vector<InstanceData> instances = { identityInstance };
 
-	vk::UniqueCommandPool cmdPool = device->createCommandPoolUnique(cmdPoolCI);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		// 並べ替えと16ビットへの縮小をしてから、GPUの頂点形式にエンコードして転送する
+		OptimizedMesh optimized = optimizeMesh(meshes[i], config.optimizeMeshes);
+		vector<uint8_t> vertices = encodeVertices(optimized.vertices, config.vertexFormat);
+
+		MeshDraw draw;
+		computeBounds(optimized.vertices, draw.boundsCenter, draw.boundsRadius);
+		draw.mesh = geometryArena.addMesh(vertices.data(), static_cast<uint32_t>(optimized.vertices.size()),
+			optimized.indexData(), optimized.indexCount(), optimized.indexType);
+		bytesUploaded += vertices.size() + optimized.indexSize() * optimized.indexCount();
+		if (draw.mesh.empty())
+		{
+			continue; // 描くものがない
+		}
 
-	vk::CommandBufferAllocateInfo cmdBufAllocInfo;
-	cmdBufAllocInfo.commandPool = cmdPool.get();
-	cmdBufAllocInfo.commandBufferCount = 1;
-	cmdBufAllocInfo.level = vk::CommandBufferLevel::ePrimary;
+		if (!meshInstances[i].empty())
+		{
+			draw.firstInstance = static_cast<uint32_t>(instances.size());
+			draw.instanceCount = static_cast<uint32_t>(meshInstances[i].size());
+			instances.insert(instances.end(), meshInstances[i].begin(), meshInstances[i].end());
+		}
+		meshDraws.push_back(draw);
+	}
 
-	vector<vk::UniqueCommandBuffer> tmpCmdBuffers = device->allocateCommandBuffersUnique(cmdBufAllocInfo);
+	// パックのメッシュはエンコード済みなので、マップしたファイルから直接ステージングにコピーする
+	for (uint32_t i = 0; i < assetPack.getEntryCount(); i++)
+	{
+		AssetView asset = assetPack.getEntry(i);
+		if (asset.type != AssetType::Mesh)
+		{
+			continue;
+		}
 
-	// Xe[WOobt@foCX[J̃obt@ɃRs[
-	vk::BufferCopy bufferCopy;
-	bufferCopy.srcOffset = 0;
-	bufferCopy.dstOffset = 0;
-	bufferCopy.size = size;
+		optional<MeshView> packed = assetPack.getMesh(asset);
+		if (!packed)
+		{
+			throw runtime_error("invalid mesh in asset pack: " + string(asset.name));
+		}
+		const PackedMeshHeader& header = *packed->header;
+		if (header.vertexFormat != config.vertexFormat)
+		{
+			std::cerr << asset.name << "の頂点形式は" << vertexFormatName(header.vertexFormat) << "ですが、"
+				<< vertexFormatName(config.vertexFormat) << "で描画しています。" << std::endl;
+			throw runtime_error("vertex format mismatch in asset pack");
+		}
+		// GeometryArenaはvertexLayout.strideで頂点を数えてコピーする
+		if (header.vertexStride != vertexLayout.stride)
+		{
+			throw runtime_error("vertex stride mismatch in asset pack: " + string(asset.name));
+		}
 
-	vk::CommandBufferBeginInfo cmdBeginInfo;
-	cmdBeginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		MeshDraw draw;
+		draw.mesh = geometryArena.addMesh(packed->vertices, header.vertexCount, packed->indices, header.indexCount, packed->indexType());
+		if (draw.mesh.empty())
+		{
+			continue;
+		}
+		draw.boundsCenter = header.boundsCenter;
+		draw.boundsRadius = header.boundsRadius;
+		bytesUploaded += uint64_t(header.vertexStride) * header.vertexCount + uint64_t(header.indexSize) * header.indexCount;
+		meshDraws.push_back(draw);
+	}
 
-	tmpCmdBuffers[0]->begin(cmdBeginInfo);
-	tmpCmdBuffers[0]->copyBuffer(stagingBuffer.get(), indexBuffer.get(), { bufferCopy });
-	tmpCmdBuffers[0]->end();
+	// 空のメッシュしかなければ大きさ0のコマンドバッファを作れないので、直接の描画（何も描かない）にする
+	if (meshDraws.empty())
+	{
+		useIndirectDraws = false;
+		useGpuCulling = false;
+	}
 
-	// submit
-	vk::CommandBuffer submitCmdBufs[1] = { tmpCmdBuffers[0].get() };
+	createInstanceBuffer(instances);
+	if (useIndirectDraws)
+	{
+		createIndirectCommands();
+	}
 
-	vk::SubmitInfo submitInfo{};
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = submitCmdBufs;
+	if (useGpuCulling)
+	{
+		// countバッファの値はmaxDrawIndirectCountまでしか許されない
+		for (const IndirectDrawBatch& batch : indirectBatches)
+		{
+			if (batch.commandCount > physDevProps.limits.maxDrawIndirectCount)
+			{
+				useGpuCulling = false;
+			}
+		}
+	}
+	if (useGpuCulling)
+	{
+		gpuCulling.init(physicalDevice, device.get(), allocator, uploadContext, geometryMemoryUsage(), cullShader.get(), pipelineManager,
+			descriptorLayoutCache, descriptorAllocator, meshDraws, indirectBatches, instanceBuffer.get(), indirectBuffer.get());
+		bytesUploaded += gpuCulling.getUploadedBytes();
+	}
 
-	graphicsQueue.submit({ submitInfo });
-	graphicsQueue.waitIdle();
+	// GPUに渡したらCPU側のデータは要らない
+	meshes.clear();
+	meshes.shrink_to_fit();
+	meshInstances.clear();
+	meshInstances.shrink_to_fit();
+	// ステージングへのコピーは済んでいるのでマップも要らない
+	assetPack.close();
 }
 
-void Vulkan::createStagingBuffer(void* data, size_t size)
+void Vulkan::createIndirectCommands()
 {
-	// obt@̍쐬
-	vk::BufferCreateInfo BufferCI{};
-	BufferCI.size = size;
-	BufferCI.usage = vk::BufferUsageFlagBits::eTransferSrc;
-	BufferCI.sharingMode = vk::SharingMode::eExclusive;
-
-	stagingBuffer = device->createBufferUnique(BufferCI);
-
-	// foCX̍쐬
-
-	// m
-	stagingBufMemory = getSuitableDevMem(stagingBuffer.get(), vk::MemoryPropertyFlagBits::eHostVisible);
-
-	// obt@ƃ̌т
-	device->bindBufferMemory(stagingBuffer.get(), stagingBufMemory.get(), 0);
+	// 描画順を変えないように、同じページと型が続く所をまとめる
+	indirectBatches.clear();
+	for (uint32_t i = 0; i < meshDraws.size(); i++)
+	{
+		const MeshHandle& mesh = meshDraws[i].mesh;
+		if (indirectBatches.empty() || indirectBatches.back().page != mesh.page || indirectBatches.back().indexType != mesh.indexType)
+		{
+			indirectBatches.push_back(IndirectDrawBatch{ mesh.page, mesh.indexType, i, 0 });
+		}
+		indirectBatches.back().commandCount++;
+	}
 
-	// }bsO
-	void* pStagingBufferMem = device->mapMemory(stagingBufMemory.get(), 0, size);
+	// コマンドは互いに独立しているのでワーカースレッドで分担して書く
+	vector<vk::DrawIndexedIndirectCommand> commands(meshDraws.size());
+	parallelFor(meshDraws.size(), 16384, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			const MeshDraw& draw = meshDraws[i];
+			commands[i].indexCount = draw.mesh.indexCount;
+			commands[i].instanceCount = draw.instanceCount;
+			commands[i].firstIndex = draw.mesh.firstIndex;
+			commands[i].vertexOffset = draw.mesh.vertexOffset;
+			commands[i].firstInstance = draw.firstInstance;
+		}
+	});
 
-	// CɃRs[
-	memcpy(pStagingBufferMem, data, size);
+	vk::DeviceSize size = sizeof(vk::DrawIndexedIndirectCommand) * commands.size();
 
-	// foCXƃC̓
-	vk::MappedMemoryRange flushMemRange;
-	flushMemRange.memory = stagingBufMemory.get();
-	flushMemRange.offset = 0; //Jn
-	flushMemRange.size = size; //傫
+	vk::BufferCreateInfo bufferCI;
+	bufferCI.size = size;
+	bufferCI.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer; // カリングの入力にもなる
+	bufferCI.sharingMode = vk::SharingMode::eExclusive;
 
-	device->flushMappedMemoryRanges({ flushMemRange });
+	indirectBuffer = device->createBufferUnique(bufferCI);
+	indirectBufMem = getSuitableDevMem(indirectBuffer.get(), geometryMemoryUsage());
+	device->bindBufferMemory(indirectBuffer.get(), indirectBufMem->memory, indirectBufMem->offset);
 
-	device->unmapMemory(stagingBufMemory.get());
+	if (indirectBufMem->mapped)
+	{
+		memcpy(indirectBufMem->mapped, commands.data(), size);
+		allocator.flush(indirectBufMem.get(), 0, size);
+	}
+	else
+	{
+		uploadContext.copyToBuffer(indirectBuffer.get(), 0, commands.data(), size);
+	}
+	bytesUploaded += size;
 }
 
-void Vulkan::createDescriptorSet()
+void Vulkan::createInstanceBuffer(const vector<InstanceData>& instances)
 {
-	auto size = sizeof(SceneData);
+	vk::DeviceSize size = sizeof(InstanceData) * instances.size();
 
 	vk::BufferCreateInfo bufferCI;
 	bufferCI.size = size;
-	bufferCI.usage = vk::BufferUsageFlagBits::eUniformBuffer;
+	bufferCI.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer; // カリングの入力にもなる
 	bufferCI.sharingMode = vk::SharingMode::eExclusive;
 
-	uniformBuffer = device->createBufferUnique(bufferCI);
-	
-	uniformBufMem = getSuitableDevMem(uniformBuffer.get(), vk::MemoryPropertyFlagBits::eHostVisible);
+	instanceBuffer = device->createBufferUnique(bufferCI);
+	instanceBufMem = getSuitableDevMem(instanceBuffer.get(), geometryMemoryUsage());
+	device->bindBufferMemory(instanceBuffer.get(), instanceBufMem->memory, instanceBufMem->offset);
+
+	if (instanceBufMem->mapped)
+	{
+		memcpy(instanceBufMem->mapped, instances.data(), size);
+		allocator.flush(instanceBufMem.get(), 0, size);
+	}
+	else
+	{
+		uploadContext.copyToBuffer(instanceBuffer.get(), 0, instances.data(), size);
+	}
+	bytesUploaded += size;
+}
 
-	device->bindBufferMemory(uniformBuffer.get(), uniformBufMem.get(), 0);
+void Vulkan::createDescriptorSet()
+{
+	descriptorLayoutCache.init(device.get());
+	descriptorAllocator.init(device.get());
+	frameAllocator.init(physicalDevice, device.get(), allocator, config.framesInFlight, config.frameAllocatorSize);
+	drawConstants.init(physDevProps.limits, sizeof(SceneData), vk::ShaderStageFlagBits::eVertex, config.pushConstants);
 
+	// プッシュ定数に収まらないときは、SceneDataをフレームごとに違う位置に置いて動的オフセットで指す
 	vk::DescriptorSetLayoutBinding dslBinding[1];
-	dslBinding[0].binding = 0; // VF[_Layout
-	dslBinding[0].descriptorType = vk::DescriptorType::eUniformBuffer;
+	dslBinding[0].binding = 0; // シェーダのLayout
+	dslBinding[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
 	dslBinding[0].descriptorCount = 1;
 	dslBinding[0].stageFlags = vk::ShaderStageFlagBits::eVertex;
 
-	vk::DescriptorSetLayoutCreateInfo dslCI;
-	dslCI.bindingCount = 1;
-	dslCI.pBindings = dslBinding;
-
-	descriptorSetLayout = device->createDescriptorSetLayoutUnique(dslCI);
-
-	vk::DescriptorPoolSize descPoolSize[1];
-	descPoolSize[0].type = vk::DescriptorType::eUniformBuffer;
-	descPoolSize[0].descriptorCount = 1;
-
-	vk::DescriptorPoolCreateInfo descriptorPoolCI;
-	descriptorPoolCI.poolSizeCount = 1;
-	descriptorPoolCI.pPoolSizes = descPoolSize;
-	descriptorPoolCI.maxSets = 1;
-
-	descriptorPool = device->createDescriptorPoolUnique(descriptorPoolCI);
-
-	auto descriSetLayouts = { descriptorSetLayout.get() };
-
-	vk::DescriptorSetAllocateInfo descrSetAllocInfo;
-	descrSetAllocInfo.descriptorPool = descriptorPool.get();
-	descrSetAllocInfo.descriptorSetCount = descriSetLayouts.size();
-	descrSetAllocInfo.pSetLayouts = descriSetLayouts.begin();
-
-	descriptorSets = device->allocateDescriptorSetsUnique(descrSetAllocInfo);
+	descriptorSetLayout = descriptorLayoutCache.get(dslBinding);
+	descriptorSet = descriptorAllocator.allocate(descriptorSetLayout);
 
+	// 書くのは一度だけ。位置はbindDescriptorSetsの動的オフセットで渡す
 	vk::DescriptorBufferInfo descrBufInfo[1];
-	descrBufInfo[0].buffer = uniformBuffer.get();
+	descrBufInfo[0].buffer = frameAllocator.getBuffer();
 	descrBufInfo[0].offset = 0;
-	descrBufInfo[0].range = size;
+	descrBufInfo[0].range = sizeof(SceneData);
 
 	vk::WriteDescriptorSet writeDescrSet;
-	writeDescrSet.dstSet = descriptorSets[0].get();
+	writeDescrSet.dstSet = descriptorSet;
 	writeDescrSet.dstBinding = 0;
 	writeDescrSet.dstArrayElement = 0;
-	writeDescrSet.descriptorType = vk::DescriptorType::eUniformBuffer;
+	writeDescrSet.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
 	writeDescrSet.descriptorCount = 1;
 	writeDescrSet.pBufferInfo = descrBufInfo;
 
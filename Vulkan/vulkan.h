@@ -1,6 +1,6 @@
 #pragma once
 
-#include <vulkan/vulkan.hpp> //Kglfw̑OɃCN[h
+#include <vulkan/vulkan.hpp> //必ずglfwの前にインクルード
 #include <GLFW/glfw3.h>
 #include <vector>
 #include <iostream>
@@ -9,20 +9,71 @@
 #include <filesystem>
 #include <string>
 #include <cstring>
+#include <chrono>
 #include "triangle.h"
+#include "mesh.h"
 #include "sceneData.h"
+#include "engineConfig.h"
+#include "gpuProfiler.h"
+#include "cpuProfiler.h"
+#include "deviceAllocator.h"
+#include "stagingRing.h"
+#include "uploadContext.h"
+#include "geometryArena.h"
+#include "meshOptimizer.h"
+#include "instanceData.h"
+#include "parallel.h"
+#include "drawList.h"
+#include "gpuCulling.h"
+#include "pipelineCache.h"
+#include "pipelineManager.h"
+#include "shaderLibrary.h"
+#include "assetPack.h"
+#include "frameAllocator.h"
+#include "drawConstants.h"
+#include "descriptorAllocator.h"
 
 using namespace std;
 
+struct FrameStats
+{
+	uint64_t frameCount = 0;
+	double elapsedSeconds = 0.0;
+	double framesPerSecond = 0.0;
+	double cpuMsPerFrame = 0.0; // fence待ちを除いたCPUの処理時間
+	double gpuMsPerFrame = 0.0; // レンダーパスのGPU時間
+	uint64_t bytesUploaded = 0; // ステージングとuniformで転送したバイト数
+	double uploadMs = 0.0; // 起動時のメッシュの準備と転送の記録にかかった時間
+	double pipelineCreateMs = 0.0; // 起動時のパイプライン作成にかかった時間
+	bool pipelineCacheWarm = false; // 有効なパイプラインキャッシュを読み込めたか
+	bool readbackMismatch = false; // 同じ入力で描いた最後の2フレームの読み戻し結果が違った
+};
+
 class Vulkan
 {
 public:
+	Vulkan(const EngineConfig& config = EngineConfig{});
+	void addMesh(Mesh mesh); // run()の前に呼ぶ。何も追加しなければ四角形を描く
+	void addInstancedMesh(Mesh mesh, vector<InstanceData> instances); // 1回のdrawIndexedでインスタンスの数だけ描く
+	// run()の前に呼ぶ。パックのメッシュをすべて描き、同じ名前のシェーダーがあれば組み込みのものの代わりに使う
+	// 戻り値はメッシュの数
+	uint32_t addAssetPack(const char* fileName);
 	void run();
+	FrameStats getFrameStats() const;
+	vector<GpuProfiler::ScopeStats> getGpuStats() const;
+	CpuProfiler::PhaseStats getCpuStats(FramePhase phase) const;
+	VertexFormat getVertexFormat() const { return config.vertexFormat; } // run()の後は実際に使った形式
+	bool usesIndirectDraws() const { return useIndirectDraws; } // run()の後に有効
+	bool usesGpuCulling() const { return useGpuCulling; } // run()の後に有効
+	bool usesPushConstants() const { return drawConstants.usesPushConstants(); } // run()の後に有効
 private:
+	void dumpCpuProfile();
 	void init();
 	void initWindow();
 	void createInstance();
 	void selectPhysicalDevice();
+	uint32_t findTransferQueueFamily(const vector<vk::QueueFamilyProperties>& props) const;
+	void selectVertexFormat();
 	void createDevice();
 	void createCommandBuffer();
 	void createRenderPass();
@@ -33,57 +84,107 @@ private:
 	void createFramebuffer();
 	void createSurface();
 	void createSwapchain();
+	vk::Extent2D chooseSwapchainExtent() const;
+	void createOffscreenTargets();
+	void createReadbackBuffers();
+	bool isRepeatedReadbackFrame() const;
+	void checkReadback();
+	void saveReadback(const char* fileName);
+	bool shouldClose();
 	void present();
 	void createFence();
 	void createSemaphore();
 	void fixSwapchain();
-	void createVertexBuffer(void* data, size_t size);
-	void createIndexBuffer(void* data, size_t size);
-	void createStagingBuffer(void *data, size_t size);
+	void uploadMeshes();
+	void createInstanceBuffer(const vector<InstanceData>& instances);
+	void createIndirectCommands();
+	void drawMeshes(vk::CommandBuffer commandBuffer, bool culled); // culledならGPUカリングの結果を描く
 	void createDescriptorSet();
-	vk::UniqueDeviceMemory getSuitableDevMem(vk::Buffer buffer, vk::MemoryPropertyFlagBits flag);
+	UniqueAllocation getSuitableDevMem(vk::Buffer buffer, const MemoryUsage& usage);
+	UniqueAllocation getSuitableDevMem(vk::Image image, const MemoryUsage& usage);
+	UniqueAllocation getSuitableDevMem(const vk::MemoryRequirements& memReq, const MemoryUsage& usage, bool linear);
+	MemoryUsage geometryMemoryUsage() const;
 
-	vector<char> readFile(const char* fileName);
-
-	GLFWwindow* window;
+	GLFWwindow* window = nullptr;
 	vk::UniqueInstance instance;
+	uint32_t instanceApiVersion = VK_API_VERSION_1_0;
 	vk::PhysicalDevice physicalDevice;
+	vk::PhysicalDeviceProperties physDevProps;
 	vk::UniqueDevice device;
+	DeviceAllocator allocator; // deviceより後、割り当てを持つメンバより前に宣言する
+	DescriptorLayoutCache descriptorLayoutCache; // レイアウトとセットを使うメンバより前に宣言する
+	DescriptorAllocator descriptorAllocator;
+	StagingRing stagingRing;
+	UploadContext uploadContext; // stagingRingより後に宣言する
+	PipelineCache pipelineCache;
 	uint32_t graphicsQueueFamIndex;
 	vk::Queue graphicsQueue;
+	uint32_t transferQueueFamIndex; // 専用のファミリーがなければgraphicsQueueFamIndexと同じ
+	vk::Queue transferQueue;
+	GpuProfiler gpuProfiler;
+	CpuProfiler cpuProfiler;
+	bool dumpKeyPressed = false;
 	vk::UniqueCommandPool commandPool;
 	vector<vk::UniqueCommandBuffer> commandBuffers;
 	vk::UniqueRenderPass renderpass;
-	vk::UniquePipeline pipeline;
 	vk::UniqueShaderModule vertShader;
 	vk::UniqueShaderModule fragShader;
+	vk::UniqueShaderModule cullShader;
 	vk::UniqueImageView imageView;
 	vk::SurfaceCapabilitiesKHR surfaceCapabilities;
 	vk::UniqueSurfaceKHR surface;
 	vk::SurfaceFormatKHR swapchainFormat;
 	vk::UniqueSwapchainKHR swapchain;
+	vk::UniqueSwapchainKHR retiredSwapchain; // oldSwapchainに渡したもの。GPUが使い終わったら破棄する
+	bool framebufferResized = false;
 	vk::PresentModeKHR swapchainPresentMode;
-	vector<vk::Image> swapchainImages;
+	vk::Extent2D swapchainExtent;
+	vector<vk::Image> swapchainImages; // ヘッドレス時はオフスクリーンのイメージ
 	vector<vk::UniqueImageView> swapchainImageViews;
 	vector<vk::UniqueFramebuffer> swapchainFrameBuffers;
 	uint32_t imageIndex;
-	vk::UniqueFence swapchainImgFence;
-	vk::UniqueSemaphore swapchainImgSemaphore, imgRenderedSemaphore;
-	vk::UniqueBuffer vertexBuffer;
-	vk::UniqueBuffer indexBuffer;
-	vk::UniqueBuffer stagingBuffer;
-	vk::UniqueBuffer uniformBuffer;
+	vector<vk::UniqueImage> offscreenImages;
+	vector<UniqueAllocation> offscreenImgMemories;
+	vector<vk::UniqueBuffer> readbackBuffers; // フレームごと
+	vector<UniqueAllocation> readbackBufMemories;
+	uint64_t renderedFrameCount = 0;
+	bool readbackMismatch = false;
+	uint64_t bytesUploaded = 0;
+	double elapsedSeconds = 0.0;
+	uint32_t currentFrame = 0;
+	vector<vk::UniqueFence> inFlightFences; // フレームごとのfence
+	vector<vk::UniqueSemaphore> swapchainImgSemaphores; // フレームごと
+	vector<vk::UniqueSemaphore> imgRenderedSemaphores; // スワップチェーンのイメージごと
+	VertexLayout vertexLayout;
+	GeometryArena geometryArena; // 全メッシュの頂点とインデックスを持つ
+	vector<MeshDraw> meshDraws;
+	vk::UniqueBuffer instanceBuffer; // 全メッシュのインスタンス。先頭はidentityInstance
+	vk::UniqueBuffer indirectBuffer; // meshDrawsと同じ並びのDrawIndexedIndirectCommand
+	vector<IndirectDrawBatch> indirectBatches;
+	bool useIndirectDraws = false;
+	bool useMultiDrawIndirect = false; // falseなら1コマンドずつdrawIndexedIndirectを呼ぶ
+	GpuCulling gpuCulling; // instanceBufferとindirectBufferから見えるものだけを詰める
+	bool useGpuCulling = false;
 	vk::PhysicalDeviceMemoryProperties physDevMemProps;
-	vk::UniqueDeviceMemory stagingBufMemory;
-	vk::UniqueDeviceMemory vertDeviceMemory;
-	vk::UniqueDeviceMemory idxDeviceMemory;
-	vk::UniqueDeviceMemory uniformBufMem;
-	vk::UniqueDescriptorSetLayout descriptorSetLayout;
-	vk::UniqueDescriptorPool descriptorPool;
-	vector<vk::UniqueDescriptorSet> descriptorSets;
+	UniqueAllocation instanceBufMem;
+	UniqueAllocation indirectBufMem;
+	FrameAllocator frameAllocator; // フレームごとのuniformなど。プッシュ定数に収まらなければSceneDataもここに置く
+	DrawConstants drawConstants; // SceneDataの渡し方
+	vk::DescriptorSetLayout descriptorSetLayout; // descriptorLayoutCacheが持つ
+	vk::DescriptorSet descriptorSet; // 全フレーム共通。フレームの違いは動的オフセットで表す
 	vk::UniquePipelineLayout pipelineLayout;
+	// 作成中のパイプラインが使うシェーダやレイアウトより後に宣言し、先にワーカーを止める
+	PipelineManager pipelineManager;
+	PipelineManager::Handle meshPipeline = PipelineManager::invalidHandle;
+
+	EngineConfig config;
 
 	Triangle triangle;
+	vector<Mesh> meshes;
+	vector<vector<InstanceData>> meshInstances; // meshesと同じ並び。空なら普通のメッシュ
+	AssetPack assetPack; // uploadMeshesまでマップしておく
+	uint32_t packMeshCount = 0;
+	double uploadMs = 0.0;
 	SceneData sceneData = { Vec2{ 0.3f, 0.0f } };
 
 	uint32_t screenWidth = 640, screenHeight = 480;